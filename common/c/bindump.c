@@ -0,0 +1,230 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+/*
+ * bindump: prints the header and the elements of files written by
+ * cholesky and set2 in binary output format (see binfmt.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "binfmt.h"
+
+static int         dump_file(char *path, int header_only);
+static long double read_elem(unsigned char *p, bin_hdr_t *hdr);
+static const char *layout_name(uint32_t layout);
+
+
+int main(int argc, char **argv)
+{
+	int opt, header_only = 0, usage = 0, ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "H")) != -1)
+	{
+		switch (opt)
+		{
+			case 'H':
+				header_only = 1;
+				break;
+			default:
+				usage = 1;
+		}
+	}
+
+	if (usage || optind >= argc)
+	{
+		fprintf(stderr, "Usage: %s [-H] FILE...\t(-H: header only)\n", argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	for (; optind < argc; optind++)
+		if (dump_file(argv[optind], header_only) != 0)
+			ret = EXIT_FAILURE;
+	return ret;
+}
+
+
+static int dump_file(char *path, int header_only)
+{
+	int fd, digits;
+	uint64_t i, j, k;
+	int64_t *row_ptr;
+	int32_t *col;
+	struct stat st;
+	unsigned char *map, *p;
+	bin_hdr_t hdr;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		perror("open");
+		return EXIT_FAILURE;
+	}
+	if (fstat(fd, &st) != 0)
+	{
+		perror("fstat");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	if ((size_t) st.st_size < BIN_HDR_SIZE)
+	{
+		fprintf(stderr, "%s: not a binary output file\n", path);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	map = (unsigned char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	memcpy(&hdr, map, sizeof(hdr));
+	hdr.version   = le32toh(hdr.version);
+	hdr.elem_size = le32toh(hdr.elem_size);
+	hdr.mant_dig  = le32toh(hdr.mant_dig);
+	hdr.layout    = le32toh(hdr.layout);
+	hdr.rows      = le64toh(hdr.rows);
+	hdr.n         = le64toh(hdr.n);
+	hdr.nnz       = le64toh(hdr.nnz);
+	if (memcmp(hdr.magic, BIN_MAGIC, sizeof(hdr.magic)) != 0 ||
+			hdr.version != BIN_VERSION)
+	{
+		fprintf(stderr, "%s: not a binary output file (version %u)\n",
+				path, BIN_VERSION);
+		goto fail;
+	}
+	if (hdr.elem_size > sizeof(long double) || (hdr.mant_dig != FLT_MANT_DIG &&
+				hdr.mant_dig != DBL_MANT_DIG &&
+				hdr.mant_dig != LDBL_MANT_DIG))
+	{
+		fprintf(stderr, "%s: elements of %u bytes (%u-bit significand) "
+				"are not supported on this machine\n", path,
+				hdr.elem_size, hdr.mant_dig);
+		goto fail;
+	}
+	if ((uint64_t) st.st_size < ((hdr.layout == BIN_CSR) ? BIN_CSR_SIZE(&hdr) :
+				BIN_HDR_SIZE + hdr.rows * hdr.n * hdr.elem_size))
+	{
+		fprintf(stderr, "%s: truncated file\n", path);
+		goto fail;
+	}
+
+	printf("# %s: %s, %llu x %llu, %u-byte elements (%u-bit significand)\n",
+			path, layout_name(hdr.layout),
+			(unsigned long long) hdr.rows, (unsigned long long) hdr.n,
+			hdr.elem_size, hdr.mant_dig);
+	if (hdr.layout == BIN_CSR)
+		printf("# %llu stored elements\n", (unsigned long long) hdr.nnz);
+	if (!header_only && hdr.layout == BIN_CSR)
+	{
+		/* One "row column value" line per element, 1-based like .mtx */
+		digits = (hdr.mant_dig == FLT_MANT_DIG) ? 9 :
+				(hdr.mant_dig == DBL_MANT_DIG) ? 17 : 21;
+		row_ptr = (int64_t *) (map + BIN_CSR_ROWS(&hdr));
+		col = (int32_t *) (map + BIN_CSR_COLS(&hdr));
+		p = map + BIN_CSR_VALS(&hdr);
+		for (i = 0, k = 0; i < hdr.rows; i++)
+			for (; k < (uint64_t) le64toh(row_ptr[i+1]) && k < hdr.nnz;
+					k++, p += hdr.elem_size)
+				printf("%llu %ld %.*Lg\n", (unsigned long long) i + 1,
+						(long) le32toh(col[k]) + 1, digits,
+						read_elem(p, &hdr));
+	}
+	else if (!header_only)
+	{
+		/* Enough significant digits to tell every value apart */
+		digits = (hdr.mant_dig == FLT_MANT_DIG) ? 9 :
+				(hdr.mant_dig == DBL_MANT_DIG) ? 17 : 21;
+		p = map + BIN_HDR_SIZE;
+		for (i = 0; i < hdr.rows; i++)
+		{
+			for (j = 0; j < hdr.n; j++, p += hdr.elem_size)
+				printf((hdr.rows == 1) ? "%.*Lg\n" : "%.*Lg  ",
+						digits, read_elem(p, &hdr));
+			if (hdr.rows > 1)
+				printf("\n");
+		}
+	}
+	munmap(map, st.st_size);
+	return EXIT_SUCCESS;
+fail:
+	munmap(map, st.st_size);
+	return EXIT_FAILURE;
+}
+
+
+/* Converts a little-endian element of the file to long double */
+static long double read_elem(unsigned char *p, bin_hdr_t *hdr)
+{
+	unsigned char elem[sizeof(long double)];
+	float f;
+	double d;
+	long double ld;
+	uint32_t k;
+
+	memset(elem, 0, sizeof(elem));
+	for (k = 0; k < hdr->elem_size; k++)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		elem[k] = p[hdr->elem_size-1-k];
+#else
+		elem[k] = p[k];
+#endif
+
+	if (hdr->mant_dig == FLT_MANT_DIG)
+	{
+		memcpy(&f, elem, sizeof(f));
+		return f;
+	}
+	if (hdr->mant_dig == DBL_MANT_DIG)
+	{
+		memcpy(&d, elem, sizeof(d));
+		return d;
+	}
+	memcpy(&ld, elem, sizeof(ld));
+	return ld;
+}
+
+
+static const char *layout_name(uint32_t layout)
+{
+	switch (layout)
+	{
+		case BIN_VECTOR:
+			return "vector";
+		case BIN_DENSE:
+			return "dense matrix";
+		case BIN_BAND:
+			return "band matrix";
+		case BIN_CSR:
+			return "sparse matrix (CSR)";
+		default:
+			return "unknown layout";
+	}
+}
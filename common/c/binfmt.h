@@ -0,0 +1,71 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+#ifndef BINFMT_H
+#define BINFMT_H
+
+#include <stdint.h>
+
+/*
+ * Binary output format: a bin_hdr_t, zero-padded to BIN_HDR_SIZE bytes,
+ * followed by rows x n elements stored row after row. The header fields
+ * and the elements are little-endian; every element takes elem_size bytes
+ * (sizeof(fptype) of the writer), of which the leading ones hold the value
+ * and the rest (e.g. the padding of x87 long doubles) are zero.
+ *
+ * Sparse matrices (BIN_CSR) are stored as three sections instead, each
+ * starting at a multiple of BIN_ALIGN bytes so that a mapping of the file
+ * can be used in place: the rows+1 row offsets (int64_t), the nnz column
+ * indices (int32_t) and the nnz values. BIN_CSR_*() give their offsets.
+ */
+#define  BIN_MAGIC       "NLABIN\0"
+#define  BIN_VERSION     1
+#define  BIN_HDR_SIZE    64
+#define  BIN_EXT         ".bin"
+#define  BIN_ALIGN       64
+#define  BIN_PAD(size)   (((size) + BIN_ALIGN - 1) & ~((uint64_t) BIN_ALIGN - 1))
+#define  BIN_CSR_ROWS(h)  ((uint64_t) BIN_HDR_SIZE)
+#define  BIN_CSR_COLS(h)  (BIN_CSR_ROWS(h) + BIN_PAD(((h)->rows + 1) * sizeof(int64_t)))
+#define  BIN_CSR_VALS(h)  (BIN_CSR_COLS(h) + BIN_PAD((h)->nnz * sizeof(int32_t)))
+#define  BIN_CSR_SIZE(h)  (BIN_CSR_VALS(h) + (h)->nnz * (h)->elem_size)
+
+typedef enum {OUT_TEXT, OUT_BINARY} output_fmt;
+
+typedef enum {
+	BIN_VECTOR = 1,         /* 1 x n */
+	BIN_DENSE  = 2,         /* n x n, row i holds A(i,0..n-1) */
+	BIN_BAND   = 3,         /* (bandwidth+1) x n, row d holds A(i,i-d) at i */
+	BIN_CSR    = 4          /* rows x n, compressed sparse rows */
+} bin_layout;
+
+typedef struct {
+	char      magic[8];     /* BIN_MAGIC */
+	uint32_t  version;      /* BIN_VERSION */
+	uint32_t  elem_size;    /* Bytes per element */
+	uint32_t  mant_dig;     /* Significand bits: 24, 53, 64 or 113 */
+	uint32_t  layout;       /* bin_layout */
+	uint64_t  rows;
+	uint64_t  n;            /* Elements per row */
+	uint64_t  nnz;          /* BIN_CSR: stored elements */
+} bin_hdr_t;
+
+#endif
@@ -0,0 +1,849 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+/*
+ * Sparse matrix input: Matrix Market coordinate files and binfmt.h
+ * BIN_CSR files, loaded into compressed sparse rows (see csr.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <endian.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csr.h"
+#include "trace.h"
+
+#define  MTX_BANNER       "%%MatrixMarket"
+/* Longest header line or number kept of a Matrix Market file */
+#define  LINE_SIZE        1024
+/* Bytes of entries parsed per thread at least, and threads at most */
+#define  MTX_MIN_CHUNK    (1 << 20)
+#define  MAX_THREADS      64
+/* Rows shorter than this are sorted in place */
+#define  SHORT_ROW        16
+/* Elements staged by csr_save() per fwrite() */
+#define  SAVE_CHUNK       4096
+
+/* See cholesky.c: one instance of this file per precision */
+#if defined(FPTYPE_FLOAT)
+	typedef float fptype;
+	#define PREC_SUFFIX    _f
+	#define FP_STRTOD      strtof
+	#define FP_MANT_DIG    FLT_MANT_DIG
+#elif defined(FPTYPE_LDOUBLE)
+	typedef long double fptype;
+	#define PREC_SUFFIX    _ld
+	#define FP_STRTOD      strtold
+	#define FP_MANT_DIG    LDBL_MANT_DIG
+#else
+	#ifndef FPTYPE_DOUBLE
+		#define FPTYPE_DOUBLE
+	#endif
+	typedef double fptype;
+	#define PREC_SUFFIX    _d
+	#define FP_STRTOD      strtod
+	#define FP_MANT_DIG    DBL_MANT_DIG
+#endif
+#if defined(FPTYPE_LDOUBLE) && LDBL_MANT_DIG == 64
+	#define FP_VALUE_BYTES 10
+#else
+	#define FP_VALUE_BYTES sizeof(fptype)
+#endif
+#define  PREC_CAT(a, b)    a##b
+#define  PREC_XCAT(a, b)   PREC_CAT(a, b)
+#define  PREC_NAME(name)   PREC_XCAT(name, PREC_SUFFIX)
+
+typedef PREC_NAME(csr_matrix) csr_matrix_t;
+
+/*
+ * A Matrix Market file is parsed in two passes over the same chunks of
+ * entry lines, split at line boundaries: the first counts the entries of
+ * every chunk and the second parses them into the triplets starting at
+ * the chunk's first entry.
+ */
+typedef struct {
+	const char *begin;          /* Entry lines [begin, end) of the chunk */
+	const char *end;
+	int         n;
+	int         pattern;        /* Entries have no value: A(i,j) = 1 */
+	int64_t     count;
+	int64_t     first;
+	int32_t    *ti;
+	int32_t    *tj;
+	fptype     *tv;
+	int         err;
+} mtx_chunk_t;
+
+typedef struct {
+	int32_t     col;
+	fptype      val;
+} csr_entry_t;
+
+static csr_matrix_t *mtx_load(const char *map, size_t size, const char *path,
+                              int nthreads);
+static const char   *mtx_line(const char *p, const char *end, char *line);
+static void          mtx_run(mtx_chunk_t *chunks, int nchunks, void *(*fn)(void *));
+static void         *mtx_count(void *arg);
+static void         *mtx_parse(void *arg);
+static int           mtx_index(const char **p, const char *end, int n, int32_t *idx);
+static int           mtx_value(const char **p, const char *end, fptype *val);
+static csr_matrix_t *csr_assemble(int32_t *ti, int32_t *tj, fptype *tv,
+                                  int64_t count, int n, int symmetric);
+static void          csr_sort_row(int32_t *col, fptype *val, int64_t len,
+                                  csr_entry_t *tmp);
+static int           csr_entry_cmp(const void *a, const void *b);
+static csr_matrix_t *bin_load(void *map, size_t size, const char *path);
+static fptype        bin_value(unsigned char *p, bin_hdr_t *hdr);
+static int           save_le(FILE *fp, const void *src, size_t count, size_t size,
+                             size_t value_bytes);
+
+
+csr_matrix_t *PREC_NAME(csr_load)(const char *path, int nthreads)
+{
+	int fd;
+	struct stat st;
+	void *map;
+	csr_matrix_t *m;
+
+	TRACE_SCOPE("csr_load");
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		perror("open");
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0)
+	{
+		perror("fstat");
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0)
+	{
+		fprintf(stderr, "%s: empty file\n", path);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		perror("mmap");
+		return NULL;
+	}
+
+	if ((size_t) st.st_size >= BIN_HDR_SIZE &&
+			memcmp(map, BIN_MAGIC, sizeof(BIN_MAGIC)) == 0)
+		/* Keeps the mapping on success */
+		return bin_load(map, st.st_size, path);
+
+	if ((size_t) st.st_size > strlen(MTX_BANNER) &&
+			memcmp(map, MTX_BANNER, strlen(MTX_BANNER)) == 0)
+	{
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		m = mtx_load((const char *) map, st.st_size, path, nthreads);
+	}
+	else
+	{
+		fprintf(stderr, "%s: neither a Matrix Market nor a binary CSR file\n",
+				path);
+		m = NULL;
+	}
+	munmap(map, st.st_size);
+	return m;
+}
+
+
+static csr_matrix_t *mtx_load(const char *map, size_t size, const char *path,
+                              int nthreads)
+{
+	char line[LINE_SIZE], object[LINE_SIZE], format[LINE_SIZE];
+	char field[LINE_SIZE], symmetry[LINE_SIZE];
+	const char *p = map, *end = map + size;
+	long long rows, cols, nnz;
+	int i, nchunks, symmetric, pattern;
+	int64_t total;
+	size_t len;
+	int32_t *ti = NULL, *tj = NULL;
+	fptype *tv = NULL;
+	mtx_chunk_t chunks[MAX_THREADS];
+	csr_matrix_t *m = NULL;
+
+	p = mtx_line(p, end, line);
+	if (sscanf(line, "%*s %s %s %s %s", object, format, field, symmetry) != 4 ||
+			strcasecmp(object, "matrix") != 0)
+	{
+		fprintf(stderr, "%s: malformed Matrix Market banner\n", path);
+		return NULL;
+	}
+	if (strcasecmp(format, "coordinate") != 0)
+	{
+		fprintf(stderr, "%s: only coordinate Matrix Market files are "
+				"supported\n", path);
+		return NULL;
+	}
+	pattern = (strcasecmp(field, "pattern") == 0);
+	if (!pattern && strcasecmp(field, "real") != 0 &&
+			strcasecmp(field, "integer") != 0)
+	{
+		fprintf(stderr, "%s: %s matrices are not supported\n", path, field);
+		return NULL;
+	}
+	symmetric = (strcasecmp(symmetry, "symmetric") == 0);
+	if (!symmetric && strcasecmp(symmetry, "general") != 0)
+	{
+		fprintf(stderr, "%s: %s matrices are not supported\n", path, symmetry);
+		return NULL;
+	}
+
+	/* Comment lines may precede the size line */
+	do
+		p = mtx_line(p, end, line);
+	while (p < end && (line[0] == '%' || line[strspn(line, " \t\r")] == '\0'));
+	if (sscanf(line, "%lld %lld %lld", &rows, &cols, &nnz) != 3 || rows != cols ||
+			rows <= 0 || rows > INT32_MAX || nnz < 0)
+	{
+		fprintf(stderr, "%s: expected the size line of a square matrix\n", path);
+		return NULL;
+	}
+
+	/* Split the entries among the threads at line boundaries */
+	len = end - p;
+	nchunks = len / MTX_MIN_CHUNK + 1;
+	if (nchunks > nthreads)
+		nchunks = nthreads;
+	if (nchunks > MAX_THREADS)
+		nchunks = MAX_THREADS;
+	if (nchunks < 1)
+		nchunks = 1;
+	for (i = 0; i < nchunks; i++)
+	{
+		chunks[i].begin = p + len / nchunks * i;
+		if (i > 0)
+		{
+			while (chunks[i].begin < end && chunks[i].begin[-1] != '\n')
+				chunks[i].begin++;
+			chunks[i-1].end = chunks[i].begin;
+		}
+		chunks[i].n = rows;
+		chunks[i].pattern = pattern;
+		chunks[i].err = 0;
+	}
+	chunks[nchunks-1].end = end;
+
+	mtx_run(chunks, nchunks, mtx_count);
+	for (i = 0, total = 0; i < nchunks; i++)
+	{
+		chunks[i].first = total;
+		total += chunks[i].count;
+	}
+	if (total != nnz)
+	{
+		fprintf(stderr, "%s: %lld entries declared, %lld found\n", path,
+				nnz, (long long) total);
+		return NULL;
+	}
+
+	ti = (int32_t *) malloc((nnz + 1) * sizeof(int32_t));
+	tj = (int32_t *) malloc((nnz + 1) * sizeof(int32_t));
+	tv = (fptype *) malloc((nnz + 1) * sizeof(fptype));
+	if (!ti || !tj || !tv)
+	{
+		perror("malloc");
+		goto out;
+	}
+	for (i = 0; i < nchunks; i++)
+	{
+		chunks[i].ti = ti;
+		chunks[i].tj = tj;
+		chunks[i].tv = tv;
+	}
+	mtx_run(chunks, nchunks, mtx_parse);
+	for (i = 0; i < nchunks; i++)
+		if (chunks[i].err)
+		{
+			fprintf(stderr, "%s: malformed entry or index out of 1..%lld\n",
+					path, rows);
+			goto out;
+		}
+
+	m = csr_assemble(ti, tj, tv, nnz, rows, symmetric);
+out:
+	free(ti);
+	free(tj);
+	free(tv);
+	return m;
+}
+
+
+/* Copies the line at p (without the newline) into line, returns the next one */
+static const char *mtx_line(const char *p, const char *end, char *line)
+{
+	size_t k = 0;
+
+	for (; p < end && *p != '\n'; p++)
+		if (k < LINE_SIZE - 1)
+			line[k++] = *p;
+	line[k] = '\0';
+	return (p < end) ? p + 1 : end;
+}
+
+
+/* Runs fn on every chunk, one thread each; chunk 0 runs on the caller */
+static void mtx_run(mtx_chunk_t *chunks, int nchunks, void *(*fn)(void *))
+{
+	int i;
+	pthread_t tid[MAX_THREADS];
+	int started[MAX_THREADS];
+
+	for (i = 1; i < nchunks; i++)
+		started[i] = (pthread_create(&tid[i], NULL, fn, &chunks[i]) == 0);
+	fn(&chunks[0]);
+	for (i = 1; i < nchunks; i++)
+	{
+		if (started[i])
+			pthread_join(tid[i], NULL);
+		else
+			fn(&chunks[i]);
+	}
+}
+
+
+/* Counts the entries of a chunk: lines other than blank and comment ones */
+static void *mtx_count(void *arg)
+{
+	mtx_chunk_t *c = (mtx_chunk_t *) arg;
+	const char *p = c->begin, *end = c->end, *nl;
+
+	TRACE_SCOPE("mtx_count");
+
+	c->count = 0;
+	while (p < end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p < end && *p != '\n' && *p != '%')
+			c->count++;
+		nl = memchr(p, '\n', end - p);
+		p = nl ? nl + 1 : end;
+	}
+	return NULL;
+}
+
+
+static void *mtx_parse(void *arg)
+{
+	mtx_chunk_t *c = (mtx_chunk_t *) arg;
+	const char *p = c->begin, *end = c->end, *nl;
+	int64_t k = c->first;
+
+	TRACE_SCOPE("mtx_parse");
+
+	while (p < end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p < end && *p != '\n' && *p != '%')
+		{
+			if (mtx_index(&p, end, c->n, &c->ti[k]) != 0 ||
+					mtx_index(&p, end, c->n, &c->tj[k]) != 0)
+			{
+				c->err = 1;
+				return NULL;
+			}
+			if (c->pattern)
+				c->tv[k] = 1;
+			else if (mtx_value(&p, end, &c->tv[k]) != 0)
+			{
+				c->err = 1;
+				return NULL;
+			}
+			k++;
+		}
+		nl = memchr(p, '\n', end - p);
+		p = nl ? nl + 1 : end;
+	}
+	return NULL;
+}
+
+
+/* Parses a 1-based index in 1..n into a 0-based one */
+static int mtx_index(const char **p, const char *end, int n, int32_t *idx)
+{
+	const char *s = *p;
+	int64_t v = 0;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if (s == end || *s < '0' || *s > '9')
+		return -1;
+	for (; s < end && *s >= '0' && *s <= '9' && v <= n; s++)
+		v = v * 10 + (*s - '0');
+	if (v < 1 || v > n)
+		return -1;
+	*idx = v - 1;
+	*p = s;
+	return 0;
+}
+
+
+/*
+ * The mapping is not NUL-terminated, so every number is copied out before
+ * it is handed to strtod().
+ */
+static int mtx_value(const char **p, const char *end, fptype *val)
+{
+	char token[LINE_SIZE], *tend;
+	const char *s = *p;
+	size_t k = 0;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	while (s < end && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n')
+	{
+		if (k == LINE_SIZE - 1)
+			return -1;
+		token[k++] = *s++;
+	}
+	token[k] = '\0';
+	*val = FP_STRTOD(token, &tend);
+	if (k == 0 || *tend != '\0')
+		return -1;
+	*p = s;
+	return 0;
+}
+
+
+/*
+ * Builds the CSR matrix of count triplets (ti, tj, tv), mirroring the
+ * off-diagonal ones of symmetric files, which hold a single triangle.
+ * Columns are sorted and duplicate entries summed.
+ */
+static csr_matrix_t *csr_assemble(int32_t *ti, int32_t *tj, fptype *tv,
+                                  int64_t count, int n, int symmetric)
+{
+	int i;
+	int64_t k, p, w, begin, end, maxlen = 0, *next;
+	csr_entry_t *tmp;
+	csr_matrix_t *m;
+
+	if (!(m = (csr_matrix_t *) calloc(1, sizeof(csr_matrix_t))))
+	{
+		perror("calloc");
+		return NULL;
+	}
+	m->n = n;
+	m->owns = 3;
+	if (!(m->row_ptr = (int64_t *) calloc(n + 1, sizeof(int64_t))) ||
+			!(next = (int64_t *) malloc(n * sizeof(int64_t))))
+	{
+		perror("malloc");
+		PREC_NAME(csr_free)(m);
+		return NULL;
+	}
+
+	for (k = 0; k < count; k++)
+	{
+		m->row_ptr[ti[k]+1]++;
+		if (symmetric && ti[k] != tj[k])
+			m->row_ptr[tj[k]+1]++;
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (m->row_ptr[i+1] > maxlen)
+			maxlen = m->row_ptr[i+1];
+		m->row_ptr[i+1] += m->row_ptr[i];
+		next[i] = m->row_ptr[i];
+	}
+	m->nnz = m->row_ptr[n];
+	m->col = (int32_t *) malloc((m->nnz + 1) * sizeof(int32_t));
+	m->val = (fptype *) malloc((m->nnz + 1) * sizeof(fptype));
+	tmp = (csr_entry_t *) malloc((maxlen + 1) * sizeof(csr_entry_t));
+	if (!m->col || !m->val || !tmp)
+	{
+		perror("malloc");
+		free(next);
+		free(tmp);
+		PREC_NAME(csr_free)(m);
+		return NULL;
+	}
+
+	for (k = 0; k < count; k++)
+	{
+		p = next[ti[k]]++;
+		m->col[p] = tj[k];
+		m->val[p] = tv[k];
+		if (symmetric && ti[k] != tj[k])
+		{
+			p = next[tj[k]]++;
+			m->col[p] = ti[k];
+			m->val[p] = tv[k];
+		}
+	}
+
+	/* Sort every row and merge its duplicates, compacting the arrays */
+	for (i = 0, w = 0, begin = 0; i < n; i++, begin = end)
+	{
+		end = m->row_ptr[i+1];
+		csr_sort_row(&m->col[begin], &m->val[begin], end - begin, tmp);
+		m->row_ptr[i] = w;
+		for (p = begin; p < end; p++)
+		{
+			if (w > m->row_ptr[i] && m->col[w-1] == m->col[p])
+				m->val[w-1] += m->val[p];
+			else
+			{
+				m->col[w] = m->col[p];
+				m->val[w] = m->val[p];
+				w++;
+			}
+		}
+	}
+	m->row_ptr[n] = m->nnz = w;
+
+	free(next);
+	free(tmp);
+	return m;
+}
+
+
+static void csr_sort_row(int32_t *col, fptype *val, int64_t len,
+                         csr_entry_t *tmp)
+{
+	int64_t k, j;
+	int32_t c;
+	fptype v;
+
+	if (len < SHORT_ROW)
+	{
+		for (k = 1; k < len; k++)
+		{
+			c = col[k];
+			v = val[k];
+			for (j = k; j > 0 && col[j-1] > c; j--)
+			{
+				col[j] = col[j-1];
+				val[j] = val[j-1];
+			}
+			col[j] = c;
+			val[j] = v;
+		}
+		return;
+	}
+
+	for (k = 0; k < len; k++)
+	{
+		tmp[k].col = col[k];
+		tmp[k].val = val[k];
+	}
+	qsort(tmp, len, sizeof(csr_entry_t), csr_entry_cmp);
+	for (k = 0; k < len; k++)
+	{
+		col[k] = tmp[k].col;
+		val[k] = tmp[k].val;
+	}
+}
+
+
+static int csr_entry_cmp(const void *a, const void *b)
+{
+	int32_t ca = ((const csr_entry_t *) a)->col;
+	int32_t cb = ((const csr_entry_t *) b)->col;
+
+	return (ca > cb) - (ca < cb);
+}
+
+
+/*
+ * Sets up a CSR matrix over the mapping of a BIN_CSR file. The row offsets
+ * and column indices are used in place on little-endian machines and the
+ * values when they are of this instance's fptype; anything else is copied.
+ */
+static csr_matrix_t *bin_load(void *map, size_t size, const char *path)
+{
+	unsigned char *base = (unsigned char *) map;
+	bin_hdr_t hdr;
+	int64_t i, k;
+	csr_matrix_t *m;
+
+	memcpy(&hdr, map, sizeof(hdr));
+	hdr.version   = le32toh(hdr.version);
+	hdr.elem_size = le32toh(hdr.elem_size);
+	hdr.mant_dig  = le32toh(hdr.mant_dig);
+	hdr.layout    = le32toh(hdr.layout);
+	hdr.rows      = le64toh(hdr.rows);
+	hdr.n         = le64toh(hdr.n);
+	hdr.nnz       = le64toh(hdr.nnz);
+	if (hdr.version != BIN_VERSION || hdr.layout != BIN_CSR ||
+			hdr.rows != hdr.n || hdr.n == 0 || hdr.n > INT32_MAX ||
+			hdr.nnz > INT64_MAX / sizeof(long double))
+	{
+		fprintf(stderr, "%s: not a square binary CSR matrix\n", path);
+		goto fail;
+	}
+	if (hdr.elem_size > sizeof(long double) || (hdr.mant_dig != FLT_MANT_DIG &&
+				hdr.mant_dig != DBL_MANT_DIG &&
+				hdr.mant_dig != LDBL_MANT_DIG))
+	{
+		fprintf(stderr, "%s: elements of %u bytes (%u-bit significand) "
+				"are not supported on this machine\n", path,
+				hdr.elem_size, hdr.mant_dig);
+		goto fail;
+	}
+	if (size < BIN_CSR_SIZE(&hdr))
+	{
+		fprintf(stderr, "%s: truncated file\n", path);
+		goto fail;
+	}
+
+	if (!(m = (csr_matrix_t *) calloc(1, sizeof(csr_matrix_t))))
+	{
+		perror("calloc");
+		goto fail;
+	}
+	m->n = hdr.n;
+	m->nnz = hdr.nnz;
+	m->map = map;
+	m->map_size = size;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	m->row_ptr = (int64_t *) malloc((hdr.n + 1) * sizeof(int64_t));
+	m->col = (int32_t *) malloc((hdr.nnz + 1) * sizeof(int32_t));
+	m->owns = 1;
+	if (!m->row_ptr || !m->col)
+	{
+		perror("malloc");
+		PREC_NAME(csr_free)(m);
+		return NULL;
+	}
+	for (i = 0; i <= m->n; i++)
+		m->row_ptr[i] = le64toh(((int64_t *) (base + BIN_CSR_ROWS(&hdr)))[i]);
+	for (k = 0; k < m->nnz; k++)
+		m->col[k] = le32toh(((int32_t *) (base + BIN_CSR_COLS(&hdr)))[k]);
+#else
+	m->row_ptr = (int64_t *) (base + BIN_CSR_ROWS(&hdr));
+	m->col = (int32_t *) (base + BIN_CSR_COLS(&hdr));
+#endif
+	if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ &&
+			hdr.elem_size == sizeof(fptype) && hdr.mant_dig == FP_MANT_DIG)
+		m->val = (fptype *) (base + BIN_CSR_VALS(&hdr));
+	else
+	{
+		if (!(m->val = (fptype *) malloc((hdr.nnz + 1) * sizeof(fptype))))
+		{
+			perror("malloc");
+			PREC_NAME(csr_free)(m);
+			return NULL;
+		}
+		m->owns |= 2;
+		for (k = 0; k < m->nnz; k++)
+			m->val[k] = bin_value(base + BIN_CSR_VALS(&hdr) +
+					k * hdr.elem_size, &hdr);
+	}
+
+	/*
+	 * The solvers index with these and rely on csr.h's sorted rows: reject
+	 * files that would send them astray, or whose columns are not strictly
+	 * increasing within every row
+	 */
+	if (m->row_ptr[0] != 0 || m->row_ptr[m->n] != m->nnz)
+		goto corrupt;
+	for (i = 0; i < m->n; i++)
+		if (m->row_ptr[i+1] < m->row_ptr[i])
+			goto corrupt;
+	for (i = 0; i < m->n; i++)
+	{
+		for (k = m->row_ptr[i]; k < m->row_ptr[i+1]; k++)
+			if (m->col[k] < 0 || m->col[k] >= m->n ||
+					(k > m->row_ptr[i] && m->col[k] <= m->col[k-1]))
+				goto corrupt;
+	}
+	return m;
+
+corrupt:
+	fprintf(stderr, "%s: corrupt row offsets or column indices, or unsorted "
+			"or duplicate columns\n", path);
+	PREC_NAME(csr_free)(m);
+	return NULL;
+fail:
+	munmap(map, size);
+	return NULL;
+}
+
+
+/* Converts a little-endian element of the file to fptype */
+static fptype bin_value(unsigned char *p, bin_hdr_t *hdr)
+{
+	unsigned char elem[sizeof(long double)];
+	float f;
+	double d;
+	long double ld;
+	uint32_t k;
+
+	memset(elem, 0, sizeof(elem));
+	for (k = 0; k < hdr->elem_size; k++)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		elem[k] = p[hdr->elem_size-1-k];
+#else
+		elem[k] = p[k];
+#endif
+
+	if (hdr->mant_dig == FLT_MANT_DIG)
+	{
+		memcpy(&f, elem, sizeof(f));
+		return f;
+	}
+	if (hdr->mant_dig == DBL_MANT_DIG)
+	{
+		memcpy(&d, elem, sizeof(d));
+		return d;
+	}
+	memcpy(&ld, elem, sizeof(ld));
+	return ld;
+}
+
+
+/* Writes m as a BIN_CSR file of this instance's fptype */
+int PREC_NAME(csr_save)(csr_matrix_t *m, const char *path)
+{
+	FILE *fp;
+	unsigned char pad[BIN_ALIGN];
+	bin_hdr_t hdr, le;
+	size_t rows_pad, cols_pad;
+	int ret = EXIT_FAILURE;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version   = BIN_VERSION;
+	hdr.elem_size = sizeof(fptype);
+	hdr.mant_dig  = FP_MANT_DIG;
+	hdr.layout    = BIN_CSR;
+	hdr.rows      = m->n;
+	hdr.n         = m->n;
+	hdr.nnz       = m->nnz;
+	le = hdr;
+	le.version    = htole32(hdr.version);
+	le.elem_size  = htole32(hdr.elem_size);
+	le.mant_dig   = htole32(hdr.mant_dig);
+	le.layout     = htole32(hdr.layout);
+	le.rows       = htole64(hdr.rows);
+	le.n          = htole64(hdr.n);
+	le.nnz        = htole64(hdr.nnz);
+	memset(pad, 0, sizeof(pad));
+
+	if (!(fp = fopen(path, "wb")))
+	{
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+	rows_pad = BIN_CSR_COLS(&hdr) - BIN_CSR_ROWS(&hdr) - (m->n + 1) * sizeof(int64_t);
+	cols_pad = BIN_CSR_VALS(&hdr) - BIN_CSR_COLS(&hdr) - m->nnz * sizeof(int32_t);
+	if (fwrite(&le, sizeof(le), 1, fp) != 1 ||
+			fwrite(pad, 1, BIN_HDR_SIZE - sizeof(le), fp) != BIN_HDR_SIZE - sizeof(le) ||
+			save_le(fp, m->row_ptr, m->n + 1, sizeof(int64_t), sizeof(int64_t)) ||
+			fwrite(pad, 1, rows_pad, fp) != rows_pad ||
+			save_le(fp, m->col, m->nnz, sizeof(int32_t), sizeof(int32_t)) ||
+			fwrite(pad, 1, cols_pad, fp) != cols_pad ||
+			save_le(fp, m->val, m->nnz, sizeof(fptype), FP_VALUE_BYTES))
+		perror("fwrite");
+	else
+		ret = EXIT_SUCCESS;
+	if (fclose(fp) != 0 && ret == EXIT_SUCCESS)
+	{
+		perror("fclose");
+		ret = EXIT_FAILURE;
+	}
+	return ret;
+}
+
+
+/*
+ * Writes count elements of size bytes little-endian, zeroing all but the
+ * leading value_bytes of each (the padding of x87 long doubles).
+ */
+static int save_le(FILE *fp, const void *src, size_t count, size_t size,
+                   size_t value_bytes)
+{
+	unsigned char buf[SAVE_CHUNK * sizeof(long double)];
+	const unsigned char *s = (const unsigned char *) src;
+	size_t i, k, len;
+
+	while (count > 0)
+	{
+		len = (count < SAVE_CHUNK) ? count : SAVE_CHUNK;
+		memset(buf, 0, len * size);
+		for (i = 0; i < len; i++, s += size)
+			for (k = 0; k < value_bytes; k++)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				buf[i*size+k] = s[value_bytes-1-k];
+#else
+				buf[i*size+k] = s[k];
+#endif
+		if (fwrite(buf, size, len, fp) != len)
+			return -1;
+		count -= len;
+	}
+	return 0;
+}
+
+
+/* y = A x */
+void PREC_NAME(csr_matvec)(csr_matrix_t *m, fptype *x, fptype *y)
+{
+	int i;
+	int64_t p;
+	fptype sum;
+
+	for (i = 0; i < m->n; i++)
+	{
+		sum = 0;
+		for (p = m->row_ptr[i]; p < m->row_ptr[i+1]; p++)
+			sum += m->val[p] * x[m->col[p]];
+		y[i] = sum;
+	}
+}
+
+
+void PREC_NAME(csr_free)(csr_matrix_t *m)
+{
+	if (!m)
+		return;
+	if (m->owns & 1)
+	{
+		free(m->row_ptr);
+		free(m->col);
+	}
+	if (m->owns & 2)
+		free(m->val);
+	if (m->map)
+		munmap(m->map, m->map_size);
+	free(m);
+}
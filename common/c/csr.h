@@ -0,0 +1,60 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+#ifndef CSR_H
+#define CSR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "binfmt.h"
+
+/*
+ * Compressed sparse row (CSR) storage of a square matrix. Symmetric
+ * matrices keep both triangles and the column indices of every row are
+ * sorted. csr_load() reads a Matrix Market coordinate file, parsed by
+ * nthreads threads, or a binfmt.h BIN_CSR file; the latter is mapped and,
+ * when its element type is fptype, used in place.
+ *
+ * csr.c is compiled once per precision, like the solvers, and every
+ * instance exports these for its own fptype.
+ */
+#define CSR_DECLARE(T, S)                                                       \
+	typedef struct {                                                        \
+		int       n;                                                    \
+		int64_t   nnz;                                                  \
+		int64_t  *row_ptr;      /* Row i is [row_ptr[i], row_ptr[i+1]) */ \
+		int32_t  *col;                                                  \
+		T        *val;                                                  \
+		void     *map;          /* Mapping of a BIN_CSR file, or NULL */ \
+		size_t    map_size;                                             \
+		int       owns;         /* Bit 0: row_ptr and col, bit 1: val */ \
+	} csr_matrix##S;                                                        \
+	csr_matrix##S *csr_load##S(const char *path, int nthreads);             \
+	int            csr_save##S(csr_matrix##S *m, const char *path);         \
+	void           csr_matvec##S(csr_matrix##S *m, T *x, T *y);             \
+	void           csr_free##S(csr_matrix##S *m);
+
+CSR_DECLARE(float, _f)
+CSR_DECLARE(double, _d)
+CSR_DECLARE(long double, _ld)
+
+#endif
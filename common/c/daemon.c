@@ -0,0 +1,227 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+/*
+ * Request loop of daemon mode (see daemon.h). Clients are served one at a
+ * time, in the order they connect: the warm state of the handler is not
+ * shared between threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+#define  DAEMON_BACKLOG   16
+
+/* Function Prototypes */
+static int  serve_stream(int in, int out, daemon_handler fn, void *arg);
+static int  stale_socket(const char *path, struct sockaddr_un *addr);
+static int  read_full(int fd, void *buf, size_t size);
+static int  write_full(int fd, const void *buf, size_t size);
+
+
+int daemon_serve(const char *path, daemon_handler fn, void *arg)
+{
+	int sock, fd;
+	struct sockaddr_un addr;
+
+	/* A client that hangs up early costs its answer, not the daemon */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!strcmp(path, "-"))
+	{
+		serve_stream(STDIN_FILENO, STDOUT_FILENO, fn, arg);
+		return EXIT_SUCCESS;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, path);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	{
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	/* A socket left behind by an earlier daemon is replaced */
+	if (stale_socket(path, &addr) != 0)
+	{
+		close(sock);
+		return EXIT_FAILURE;
+	}
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+			listen(sock, DAEMON_BACKLOG) != 0)
+	{
+		perror(path);
+		close(sock);
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "Listening on %s\n", path);
+
+	for (;;)
+	{
+		if ((fd = accept(sock, NULL, NULL)) < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			break;
+		}
+		serve_stream(fd, fd, fn, arg);
+		close(fd);
+	}
+	close(sock);
+	unlink(path);
+	return EXIT_FAILURE;
+}
+
+
+/*
+ * Removes path if it is a socket nobody listens on. Returns EXIT_FAILURE,
+ * leaving path alone, if it is something else or a daemon is serving it.
+ */
+static int stale_socket(const char *path, struct sockaddr_un *addr)
+{
+	int fd, live;
+	struct stat st;
+
+	if (lstat(path, &st) != 0)
+	{
+		if (errno == ENOENT)
+			return EXIT_SUCCESS;
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	if (!S_ISSOCK(st.st_mode))
+	{
+		fprintf(stderr, "%s: exists and is not a socket\n", path);
+		return EXIT_FAILURE;
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	{
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	live = (connect(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0);
+	close(fd);
+	if (live)
+	{
+		fprintf(stderr, "%s: a daemon is already listening on it\n", path);
+		return EXIT_FAILURE;
+	}
+	if (unlink(path) != 0)
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Answers the requests read from in until it ends or a request or answer
+ * cannot be transferred; a request without DAEMON_MAGIC is answered with
+ * EPROTO and ends the stream, since it can no longer be framed.
+ */
+static int serve_stream(int in, int out, daemon_handler fn, void *arg)
+{
+	daemon_req_t req;
+	daemon_resp_t resp;
+	const void *x;
+
+	while (read_full(in, &req, sizeof(req)) == 0)
+	{
+		memset(&resp, 0, sizeof(resp));
+		x = NULL;
+		if (req.magic != DAEMON_MAGIC)
+			resp.status = EPROTO;
+		else
+			fn(&req, &resp, &x, arg);
+		resp.magic = DAEMON_MAGIC;
+		if (resp.status != 0)
+			resp.n = 0;
+
+		if (write_full(out, &resp, sizeof(resp)) != 0 ||
+				(resp.n > 0 && write_full(out, x, (size_t) resp.n * resp.elem_size) != 0))
+			return EXIT_FAILURE;
+		if (req.magic != DAEMON_MAGIC)
+			return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/* Returns EXIT_FAILURE on errors and at the end of the stream */
+static int read_full(int fd, void *buf, size_t size)
+{
+	ssize_t r;
+	char *p = (char *) buf;
+
+	while (size > 0)
+	{
+		if ((r = read(fd, p, size)) < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+		{
+			if (r < 0)
+				perror("read");
+			return EXIT_FAILURE;
+		}
+		p += r;
+		size -= (size_t) r;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int write_full(int fd, const void *buf, size_t size)
+{
+	ssize_t r;
+	const char *p = (const char *) buf;
+
+	while (size > 0)
+	{
+		if ((r = write(fd, p, size)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return EXIT_FAILURE;
+		}
+		p += r;
+		size -= (size_t) r;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+
+/*
+ * Daemon mode (-d): solve requests are read from a Unix stream socket, or
+ * from stdin with the answers written to stdout, and served one after the
+ * other by a process that keeps its workspaces and factors warm between
+ * them. Every request is a daemon_req_t; every answer is a daemon_resp_t
+ * followed by resp.n elements of x, elem_size bytes each. Both sides run
+ * on the same host, so all fields are in its native byte order.
+ */
+#define  DAEMON_MAGIC    0x4e4c4144u    /* "DALN" */
+
+typedef struct {
+	uint32_t  magic;        /* DAEMON_MAGIC */
+	uint32_t  n;
+	uint32_t  system;       /* 1: A1 x = b1, 2: A2 x = b2 */
+	uint32_t  method;       /* cholesky: factor_alg, set2: set2_method */
+	uint32_t  precision;    /* precision: 0 float, 1 double, 2 long double */
+	uint32_t  reserved;     /* Zero */
+	double    tol;          /* set2: tolerance on ||r||, <= 0 for the default;
+	                           EINVAL if below the rounding error of b */
+} daemon_req_t;
+
+typedef struct {
+	uint32_t  magic;        /* DAEMON_MAGIC */
+	int32_t   status;       /* 0, or an error code and no x follows:
+	                           EINVAL, ENOMEM, EPROTO or a solver's own,
+	                           e.g. ETIMEDOUT if set2 ran out of iterations */
+	uint32_t  n;            /* Elements of x that follow */
+	uint32_t  elem_size;    /* Bytes per element of x */
+	int32_t   iterations;   /* set2: iterations run, cholesky: 0 */
+	uint32_t  cached;       /* A (and its factor) came from the cache */
+	double    setup;        /* Seconds generating and factoring A, 0 if cached */
+	double    solve;        /* Seconds of the solve */
+	double    residual;     /* set2: ||r|| at exit, cholesky: 0 */
+} daemon_resp_t;
+
+/*
+ * Answers req: fills in resp (magic excepted) and, on success, points *x
+ * at the resp->n elements, which must stay valid until the next call.
+ */
+typedef void (*daemon_handler)(const daemon_req_t *req, daemon_resp_t *resp,
+		const void **x, void *arg);
+
+/*
+ * Serves requests from path ("-" for stdin/stdout) until the stream ends,
+ * or forever on a socket; returns EXIT_FAILURE if it cannot be set up.
+ */
+int daemon_serve(const char *path, daemon_handler fn, void *arg);
+
+#endif
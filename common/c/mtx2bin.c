@@ -0,0 +1,99 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+/*
+ * mtx2bin: converts a Matrix Market file to a binary CSR file (see
+ * binfmt.h), which cholesky -i and set2 -i map instead of parsing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csr.h"
+
+
+int main(int argc, char **argv)
+{
+	int opt, threads = 0, usage = 0, ret = EXIT_FAILURE;
+	char *prec = "double";
+	csr_matrix_f *mf;
+	csr_matrix_d *md;
+	csr_matrix_ld *mld;
+
+	while ((opt = getopt(argc, argv, "p:t:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p':
+				prec = optarg;
+				break;
+			case 't':
+				if ((threads = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of threads should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			default:
+				usage = 1;
+		}
+	}
+
+	if (usage || argc - optind != 2)
+	{
+		fprintf(stderr, "Usage: %s [-p float|double|ldouble] [-t threads] "
+				"IN.mtx OUT.bin\n", argv[0]);
+		return EXIT_SUCCESS;
+	}
+	if (threads == 0)
+		threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* The values are stored in the precision they are read in */
+	if (!strcmp(prec, "float"))
+	{
+		if ((mf = csr_load_f(argv[optind], threads)))
+		{
+			ret = csr_save_f(mf, argv[optind+1]);
+			csr_free_f(mf);
+		}
+	}
+	else if (!strcmp(prec, "double"))
+	{
+		if ((md = csr_load_d(argv[optind], threads)))
+		{
+			ret = csr_save_d(md, argv[optind+1]);
+			csr_free_d(md);
+		}
+	}
+	else if (!strcmp(prec, "ldouble"))
+	{
+		if ((mld = csr_load_ld(argv[optind], threads)))
+		{
+			ret = csr_save_ld(mld, argv[optind+1]);
+			csr_free_ld(mld);
+		}
+	}
+	else
+		fprintf(stderr, "Unknown precision: %s\n", prec);
+	return ret;
+}
@@ -0,0 +1,163 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+
+/*
+ * Span recording for TRACE_SCOPE() (see trace.h). Every thread appends
+ * its completed spans to buffers of its own, so recording takes no lock
+ * but when a buffer fills up; all buffers are written out at exit.
+ */
+
+#ifdef TRACE
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define  TRACE_FILE_ENV     "TRACE_FILE"
+#define  TRACE_FILE         "trace.json"
+#define  TRACE_BUF_EVENTS   4096
+
+typedef struct {
+	const char  *name;
+	uint64_t     start;
+	uint64_t     dur;
+} trace_event_t;
+
+typedef struct trace_buf {
+	struct trace_buf  *next;        /* All buffers, newest first */
+	long               tid;
+	int                used;
+	trace_event_t      ev[TRACE_BUF_EVENTS];
+} trace_buf_t;
+
+static uint64_t     trace_now(void);
+static trace_buf_t *trace_buf_new(void);
+static void         trace_init(void);
+static void         trace_write(void);
+
+static pthread_mutex_t     trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t      trace_once = PTHREAD_ONCE_INIT;
+static trace_buf_t        *trace_bufs;
+static __thread trace_buf_t *trace_cur;
+
+
+trace_span_t trace_begin(const char *name)
+{
+	trace_span_t span;
+
+	pthread_once(&trace_once, trace_init);
+	span.name = name;
+	span.start = trace_now();
+	return span;
+}
+
+
+void trace_end(trace_span_t *span)
+{
+	uint64_t end = trace_now();
+	trace_event_t *ev;
+
+	if ((!trace_cur || trace_cur->used == TRACE_BUF_EVENTS) &&
+			!(trace_cur = trace_buf_new()))
+		return;
+	ev = &trace_cur->ev[trace_cur->used++];
+	ev->name = span->name;
+	ev->start = span->start;
+	ev->dur = end - span->start;
+}
+
+
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static trace_buf_t *trace_buf_new(void)
+{
+	trace_buf_t *buf;
+
+	if (!(buf = (trace_buf_t *) malloc(sizeof(trace_buf_t))))
+	{
+		perror("malloc");
+		return NULL;
+	}
+	buf->tid = syscall(SYS_gettid);
+	buf->used = 0;
+	pthread_mutex_lock(&trace_lock);
+	buf->next = trace_bufs;
+	trace_bufs = buf;
+	pthread_mutex_unlock(&trace_lock);
+	return buf;
+}
+
+
+static void trace_init(void)
+{
+	atexit(trace_write);
+}
+
+
+/* Complete ("X") events with microsecond timestamps, one lane per tid */
+static void trace_write(void)
+{
+	const char *path = getenv(TRACE_FILE_ENV) ? getenv(TRACE_FILE_ENV) : TRACE_FILE;
+	FILE *fp;
+	trace_buf_t *buf;
+	int i, first = 1;
+	long pid = getpid();
+
+	if (!(fp = fopen(path, "w")))
+	{
+		perror("fopen");
+		return;
+	}
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	pthread_mutex_lock(&trace_lock);
+	for (buf = trace_bufs; buf; buf = buf->next)
+	{
+		/* Names the lane; repeated for threads that filled several buffers */
+		fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+				"\"tid\":%ld,\"args\":{\"name\":\"%s %ld\"}}",
+				first ? "" : ",", pid, buf->tid,
+				(buf->tid == pid) ? "main" : "worker", buf->tid);
+		first = 0;
+		for (i = 0; i < buf->used; i++)
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,"
+					"\"ts\":%.3f,\"dur\":%.3f}", buf->ev[i].name, pid,
+					buf->tid, buf->ev[i].start * 1e-3, buf->ev[i].dur * 1e-3);
+	}
+	pthread_mutex_unlock(&trace_lock);
+	fprintf(fp, "\n]}\n");
+	if (fclose(fp) != 0)
+		perror("fclose");
+}
+
+#endif
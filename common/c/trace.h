@@ -0,0 +1,53 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Timeline tracing. Built with -DTRACE (make TRACE=1), TRACE_SCOPE(name)
+ * opens a span that closes when the enclosing block is left, and every
+ * span is written at exit to the file named by $TRACE_FILE (default:
+ * trace.json) in Chrome trace event format, one lane per thread, for
+ * chrome://tracing or ui.perfetto.dev. Otherwise TRACE_SCOPE() expands to
+ * nothing. name must be a string literal (or otherwise outlive the run).
+ */
+#ifdef TRACE
+	#include <stdint.h>
+
+	typedef struct {
+		const char  *name;
+		uint64_t     start;     /* ns, CLOCK_MONOTONIC */
+	} trace_span_t;
+
+	trace_span_t trace_begin(const char *name);
+	void         trace_end(trace_span_t *span);
+
+	#define TRACE_CAT(a, b)     a##b
+	#define TRACE_XCAT(a, b)    TRACE_CAT(a, b)
+	#define TRACE_SCOPE(name)                                               \
+		trace_span_t TRACE_XCAT(trace_span_, __LINE__)                  \
+			__attribute__((cleanup(trace_end))) = trace_begin(name)
+#else
+	#define TRACE_SCOPE(name)
+#endif
+
+#endif
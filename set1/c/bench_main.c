@@ -0,0 +1,121 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+/*
+ * bench: times the kernels of cholesky.c for every N given and prints one
+ * CSV line per (N, kernel). Built for both storage variants, as bench and
+ * bench-optimal; "make benchmark" runs both into bench.csv.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cholesky.h"
+
+#ifdef OPTIMIZED
+	#define VARIANT  "optimized"
+#else
+	#define VARIANT  "baseline"
+#endif
+
+static const char *kernel_names[NUM_BENCH_KERNELS] = {
+	"cholesky_decomposition", "forward_substitution", "back_substitution"
+};
+
+
+int main(int argc, char **argv)
+{
+	int i, k, n, opt, warmup = 2, reps = 10, header = 1, usage = 0;
+	char *prec = "double";
+	bench_result_t res[NUM_BENCH_KERNELS];
+	int (*bench)(int, int, int, bench_result_t *) = cholesky_bench_d;
+
+	while ((opt = getopt(argc, argv, "Hp:r:w:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'H':
+				header = 0;
+				break;
+			case 'p':
+				prec = optarg;
+				if (!strcmp(optarg, "float"))
+					bench = cholesky_bench_f;
+				else if (!strcmp(optarg, "double"))
+					bench = cholesky_bench_d;
+				else if (!strcmp(optarg, "ldouble"))
+					bench = cholesky_bench_ld;
+				else
+				{
+					fprintf(stderr, "Unknown precision: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'r':
+				if ((reps = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of timed runs should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'w':
+				if ((warmup = atoi(optarg)) < 0)
+				{
+					fprintf(stderr, "Number of warm-up runs should not be negative!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			default:
+				usage = 1;
+		}
+	}
+
+	if (usage || optind >= argc)
+	{
+		fprintf(stderr, "Usage: %s [-H] [-p float|double|ldouble] [-r runs] "
+				"[-w warm-up runs] N...\t(-H: no CSV header)\n", argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if (header)
+		printf("variant,precision,kernel,n,warmup,runs,median_s,p95_s,"
+				"flops,bytes,gflop_per_s,gbyte_per_s,bytes_per_flop\n");
+	for (i = optind; i < argc; i++)
+	{
+		if ((n = atoi(argv[i])) <= 0)
+		{
+			fprintf(stderr, "Matrix size (N) should be positive!\n");
+			return EXIT_FAILURE;
+		}
+		if (bench(n, warmup, reps, res) != 0)
+			return EXIT_FAILURE;
+		for (k = 0; k < NUM_BENCH_KERNELS; k++)
+			printf("%s,%s,%s,%d,%d,%d,%.9f,%.9f,%.0f,%.0f,%.4f,%.4f,%.4f\n",
+					VARIANT, prec, kernel_names[k], n, warmup, reps,
+					res[k].median, res[k].p95, res[k].flops, res[k].bytes,
+					res[k].flops / res[k].median * 1e-9,
+					res[k].bytes / res[k].median * 1e-9,
+					res[k].bytes / res[k].flops);
+		fflush(stdout);
+	}
+	return EXIT_SUCCESS;
+}
@@ -21,75 +21,572 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <math.h>
+#include <float.h>
+#include <time.h>
+#include <stdint.h>
+#include <endian.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cholesky.h"
+#include "csr.h"
+#include "trace.h"
 
-#define  BUFF_SIZE	16
+#define  BUFF_SIZE	32
+#define  ALIGNMENT        64
+#define  HUGE_PAGE_SIZE   (2UL << 20)
+/* Elements per cache line; matrix rows are padded to a multiple of it */
+#define  FPS_PER_LINE     (ALIGNMENT / sizeof(fptype))
+#define  ROW_STRIDE(n)    (((size_t) (n) + FPS_PER_LINE - 1) / FPS_PER_LINE * FPS_PER_LINE)
+/* Right-hand sides swept together by the block substitutions */
+#define  RHS_BLOCK        ((int) FPS_PER_LINE)
+#define  PATH_SIZE        4096
+/* Bytes staged by the binary writer per write() */
+#define  BIN_CHUNK        (1 << 20)
+#define  FACTOR_CACHE_DIR_ENV   "CHOLESKY_CACHE_DIR"
+#define  FACTOR_CACHE_MAGIC     "CHOLFAC"
+#define  FACTOR_CACHE_VERSION   2
+/* Tiled factorization: tile size and micro-kernel register block */
+#define  TILE_SIZE        64
+#if defined(__AVX512F__)
+	#define  VEC_BYTES    64
+#elif defined(__AVX__)
+	#define  VEC_BYTES    32
+#else
+	#define  VEC_BYTES    16
+#endif
+#define  VEC_LANES        ((int) (sizeof(fpvec) / sizeof(fptype)))
+#define  MR               4
+#define  NR               (2 * VEC_LANES)
+/* Mixed-precision solve: refinement steps before giving up on float */
+#define  MAX_REFINE_STEPS 30
+#define  FP_ABS(x)        ((x) < 0 ? -(x) : (x))
+/* Batched solves: systems per group and lane v of a batch vector */
+#define  BATCH_LANES      ((int) (sizeof(fpbatch) / sizeof(fptype)))
+#define  LANE(x, v)       (((fptype *) &(x))[v])
+/* Toeplitz solves: rows of L that must agree, and to how many ulps */
+#define  TOEPLITZ_RUN     (BANDWIDTH + 1)
+#define  TOEPLITZ_ULPS    4
+/* Sparse solves: subgraphs nested dissection leaves in breadth-first order */
+#define  ND_LEAF          64
+#define  ND_ROOT_TRIES    4
+/* Columns of a supernodal update computed together, see sparse_block() */
+#define  SN_COLS          4
 
 // #define  PRINT_INPUT_MATRICES
 // #define  VERIFY_CHOLESKY_DECOMP
 // #define  PRINT_INTERMEDIATE_RESULTS
 #define  PRINT_RESULTS
 // #define  PRINT_TOFILE
+// #define  USE_HUGE_PAGES
+// #define  USE_FACTOR_CACHE
 
-#if 1
-	#define FPTYPE_DOUBLE
+/*
+ * The precision is picked by the build: this file is compiled once for
+ * each of FPTYPE_FLOAT, FPTYPE_DOUBLE (default) and FPTYPE_LDOUBLE, and
+ * PREC_NAME() gives the exported symbols of every instance a suffix.
+ */
+#if defined(FPTYPE_FLOAT)
+	typedef float fptype;
+	#define PREC_SUFFIX    _f
+	#define FP_SQRT        sqrtf
+	#define FP_EPSILON     FLT_EPSILON
+	#define FP_MIN         FLT_MIN
+	#define FP_MANT_DIG    FLT_MANT_DIG
+	#define FP_NAME        "float"
+#elif defined(FPTYPE_LDOUBLE)
+	typedef long double fptype;
+	#define PREC_SUFFIX    _ld
+	#define FP_SQRT        sqrtl
+	#define FP_EPSILON     LDBL_EPSILON
+	#define FP_MIN         LDBL_MIN
+	#define FP_MANT_DIG    LDBL_MANT_DIG
+	#define FP_NAME        "long double"
+#else
+	#ifndef FPTYPE_DOUBLE
+		#define FPTYPE_DOUBLE
+	#endif
 	typedef double fptype;
+	#define PREC_SUFFIX    _d
+	#define FP_SQRT        sqrt
+	#define FP_EPSILON     DBL_EPSILON
+	#define FP_MIN         DBL_MIN
+	#define FP_MANT_DIG    DBL_MANT_DIG
+	#define FP_NAME        "double"
+#endif
+#if defined(FPTYPE_LDOUBLE) && LDBL_MANT_DIG == 64
+	/* x87 extended precision: the trailing bytes are padding */
+	#define FP_VALUE_BYTES 10
 #else
-	#undef FPTYPE_DOUBLE
-	typedef float fptype;
+	#define FP_VALUE_BYTES sizeof(fptype)
+#endif
+#define  PREC_CAT(a, b)    a##b
+#define  PREC_XCAT(a, b)   PREC_CAT(a, b)
+#define  PREC_NAME(name)   PREC_XCAT(name, PREC_SUFFIX)
+
+#ifdef OPTIMIZED
+	/*
+	 * Band storage: only the main diagonal and the BANDWIDTH sub-diagonals
+	 * are kept, so every matrix is (BANDWIDTH+1) x n instead of n x n.
+	 * Row i of a lower triangular (or symmetric) matrix keeps element
+	 * (i, i-d) at mat[d][i].
+	 */
+	#define BANDWIDTH     2
+	#define NUM_ROWS(n)   (BANDWIDTH+1)
+	/* Element (i,j), j <= i, of a lower triangular or symmetric matrix */
+	#define LOWER(m, i, j)  ((m)[(i)-(j)][i])
+	/*
+	 * Out-of-core solver: every row i is spilled as a record of L(i,i-d),
+	 * d = 0..BANDWIDTH, followed by y(i) (overwritten by x(i) later on),
+	 * STREAM_CHUNK records at a time.
+	 */
+	#define STREAM_REC    (BANDWIDTH+2)
+	#define STREAM_CHUNK  65536
+#else
+	#define NUM_ROWS(n)   (n)
+	#define LOWER(m, i, j)  ((m)[i][j])
 #endif
 
 typedef enum {S1=1, S2} sys_id;
 
+#ifdef FPTYPE_LDOUBLE
+	/* GCC has no long double vectors: the micro-kernel runs on scalars */
+	typedef fptype fpvec;
+	typedef fptype fpbatch;
+#else
+	/* SIMD vector of VEC_LANES fptype elements (GCC vector extension) */
+	typedef fptype fpvec __attribute__((vector_size(VEC_BYTES)));
+	/*
+	 * Lanes of a batched solve: two SIMD vectors, so that the long
+	 * latency divisions and square roots of two groups of systems overlap
+	 */
+	typedef fptype fpbatch __attribute__((vector_size(2 * VEC_BYTES)));
+#endif
+
+/*
+ * Solver-scoped workspace: one aligned block is allocated per run and work
+ * vectors are carved out of it; arena_reset() hands them all back at once.
+ */
+typedef struct {
+	char   *base;
+	size_t  size;
+	size_t  used;
+} arena_t;
+
+/*
+ * Factorization handle: A = L * L^T is computed once by cholesky_factorize()
+ * and cholesky_solve() can then be called for any number of right-hand
+ * side blocks.
+ */
+typedef struct {
+	int      n;
+	fptype **l;
+	void    *map;       /* Read-only mapping of a cached factor, or NULL */
+	size_t   map_size;
+} cholesky_factor_t;
+
+/* Exported handle: a factor together with the workspace it lives in */
+typedef struct PREC_NAME(cholesky_handle) cholesky_handle_t;
+
+struct PREC_NAME(cholesky_handle) {
+	arena_t            ws;
+	cholesky_factor_t  f;
+};
+
+/*
+ * Daemon state (see daemon.h): the factors of the systems solved last, so
+ * that a repeated request goes straight to the triangular solves. Full,
+ * the cache replaces its least recently used entry.
+ */
+#define  SERVER_CACHE     4
+
+typedef struct {
+	sys_id              sid;        /* 0 if the entry is empty */
+	int                 n;
+	factor_alg          alg;
+	fptype             *b;
+	cholesky_handle_t  *h;
+	unsigned long       used;       /* Request count at the last use */
+} server_entry_t;
+
+typedef struct PREC_NAME(cholesky_server) cholesky_server_t;
+
+struct PREC_NAME(cholesky_server) {
+	solve_opts_t    opts;
+	server_entry_t  cache[SERVER_CACHE];
+	unsigned long   requests;
+};
+
+/* Binary output file being written; see bin_open() */
+typedef struct {
+	int             fd;
+	size_t          used;       /* Bytes staged in buf */
+	unsigned char  *buf;
+} bin_writer_t;
+
+/*
+ * On-disk factor cache entry: this header, padded to ALIGNMENT bytes, is
+ * followed by the NUM_ROWS(n) x ROW_STRIDE(n) elements of L exactly as
+ * they are laid out in memory, so a mapping of the file is used as is,
+ * and by the NUM_ROWS(n) x n stored elements of the A it factors, which
+ * a hit must match.
+ */
+typedef struct {
+	char      magic[8];
+	uint32_t  version;
+	uint32_t  fptype_size;
+	uint64_t  hash;
+	int64_t   n;
+	int64_t   rows;
+	int64_t   stride;
+} factor_cache_hdr_t;
+
+#define  FACTOR_CACHE_HDR_SIZE  \
+	((sizeof(factor_cache_hdr_t) + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1))
+
+/*
+ * Tiled factorization: the lower triangle of L is split into TILE_SIZE x
+ * TILE_SIZE tiles and factored right-looking by three kinds of tasks:
+ * POTRF(k) factors diagonal tile (k,k), TRSM(i,k) solves tile (i,k)
+ * against it and UPDATE(i,j,k) subtracts L(i,k) * L(j,k)^T from the
+ * trailing tile (i,j). Tasks become ready as their inputs complete.
+ */
+typedef enum {TASK_POTRF, TASK_TRSM, TASK_UPDATE} tile_task_type;
+
+typedef struct {
+	tile_task_type  type;
+	int             i, j, k;
+} tile_task_t;
+
+typedef struct {
+	fptype         **l;
+	int              n, nt, ld;
+	int             *updates;       /* Updates applied to tile (i,j) */
+	char            *trsm_done;     /* TRSM(i,k) completed */
+	char            *potrf_done;    /* POTRF(k) completed */
+	int              finished;
+	tile_task_t     *queue;         /* Ring buffer of ready tasks */
+	int              qcap, qhead, qlen;
+	pthread_mutex_t  lock;
+	pthread_cond_t   ready;
+} tile_sched_t;
+
+#ifdef OPTIMIZED
+/*
+ * Partitioned solver: the rows are split into blocks of interior rows,
+ * separated by BANDWIDTH separator rows, and every block is reduced by its
+ * own thread to its contribution to the Schur complement of the
+ * separators. With L_I the factor of the interior block A_I and U, V the
+ * columns of A that couple it to the separators before and after it,
+ * these are U^T A_I^-1 U, V^T A_I^-1 V, V^T A_I^-1 U, U^T A_I^-1 b and
+ * V^T A_I^-1 b, each computed from L_I^-1 U, L_I^-1 V and L_I^-1 b.
+ */
+typedef struct {
+	fptype  **a, **l;
+	fptype   *b, *x;
+	int       lo, hi;       /* Interior rows [lo, hi) */
+	int       left, right;  /* Separator before / after the block */
+	fptype    uu[BANDWIDTH][BANDWIDTH], vv[BANDWIDTH][BANDWIDTH],
+	          vu[BANDWIDTH][BANDWIDTH], ug[BANDWIDTH], vg[BANDWIDTH];
+} spike_block_t;
+
+/*
+ * Band factor whose rows converge: rows 0..rows-1 of L are stored and
+ * every later row equals row rows-1, see toeplitz_factor().
+ */
+typedef struct {
+	int       n;
+	int       rows;
+	fptype   *l;
+} toeplitz_factor_t;
+#endif
+
+typedef PREC_NAME(csr_matrix) csr_matrix_t;
+
+/*
+ * Symbolic analysis of a sparse SPD matrix A: the fill-reducing ordering
+ * P, the elimination tree of P A P^T and the supernodes of its factor L.
+ * It depends on the pattern of A only, so one analysis serves every
+ * matrix with that pattern.
+ */
+typedef struct {
+	int       n;
+	int      *perm;         /* Row and column k of P A P^T are perm[k] of A */
+	int      *pinv;
+	int      *parent;       /* Elimination tree of P A P^T, -1 at the roots */
+	int      *count;        /* Entries of every column of L */
+	int64_t   nnz;          /* Entries of L */
+	int       nsuper;
+	int      *super;        /* Supernode s is columns [super[s], super[s+1]) */
+	int      *col_super;    /* Supernode of every column */
+	int64_t  *rp;           /* Rows of supernode s are ri[rp[s]..rp[s+1]-1] */
+	int32_t  *ri;
+	int64_t  *xp;           /* Supernode s is a column-major block at lx + xp[s] */
+	int       max_rows;
+} sparse_symbolic_t;
+
+/*
+ * Numeric factor of a sparse_symbolic_t: every supernode of L is a dense
+ * column-major block, with a row for each of its rows and the diagonal
+ * block on top.
+ */
+typedef struct {
+	fptype   *lx;
+	int      *map;          /* Position of every row in the supernode updated */
+	int      *head;         /* Supernodes waiting to update every supernode */
+	int      *next;
+	int64_t  *pos;          /* First row of every supernode not applied yet */
+	fptype   *buf;          /* SN_COLS update columns of max_rows elements */
+} sparse_factor_t;
+
+/*
+ * Exported sparse handle: the analysis of a pattern, a copy of that
+ * pattern that the matrices factored are checked against, the factor of
+ * the last of them and the work vector of the solves.
+ */
+typedef struct PREC_NAME(cholesky_sparse) sparse_handle_t;
+
+struct PREC_NAME(cholesky_sparse) {
+	sparse_symbolic_t  sym;
+	sparse_factor_t    f;
+	int64_t            nnz;
+	int64_t           *row_ptr;
+	int32_t           *col;
+	fptype            *y;
+};
+
+/* Workspace of the nested dissection ordering */
+typedef struct {
+	csr_matrix_t *a;
+	int      *part;         /* Subgraph of every vertex, -1 once ordered */
+	int      *seen;         /* Last BFS that reached every vertex */
+	int      *level;        /* Distance from the root of that BFS */
+	int      *level_size;
+	int      *queue;
+	int      *tmp;
+	int       stamp;
+	int       parts;
+} nd_work_t;
+
+/*
+ * Skyline (profile) storage of a lower triangular or symmetric matrix:
+ * row i keeps columns first[i]..i, contiguous, from val + ptr[i]. The
+ * Cholesky factor has no fill outside the profile of A, so L overwrites A
+ * in place.
+ */
+typedef struct {
+	int       n;
+	int      *first;        /* Column of the first nonzero of every row */
+	int64_t  *ptr;
+	fptype   *val;
+} skyline_t;
+
 /* Function Prototypes */
-int       alloc_2d_matrices(int n, int num_args, ...);
-int       alloc_1d_matrices(int n, int num_args, ...);
-fptype  **alloc_2d_matrix(int n);
-fptype   *alloc_1d_matrix(int n);
-void      init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n);
-void      write_2d_matrix(char *filename, fptype **mat, int n);
-void      write_1d_matrix(char *filename, fptype *mat, int n);
-void      print_input_matrices(void);
-void      solve_system(fptype **a, fptype *b, int n, sys_id sid);
-fptype  **cholesky_decomposition(fptype **a, int n);
-void      verify_cholesky_decomposition(fptype **l, int n, sys_id sid);
-fptype  **transpose(fptype **mat, int n);
-fptype   *forward_substitution(fptype **l, fptype *b, int n);
-fptype   *back_substitution(fptype **l, fptype *b, int n);
-void      free_1d_matrices(int num_args, ...);
-void      free_2d_matrices(int n, int num_args, ...);
-void      free_2d_matrix(fptype **mat, int n);
-
-
-int main(int argc, char **argv)
-{
-	int n;
+static int       alloc_2d_matrices(int n, int num_args, ...);
+static int       alloc_1d_matrices(int n, int num_args, ...);
+static fptype  **alloc_2d_matrix(int n);
+static fptype   *alloc_1d_matrix(int n);
+static void     *alloc_aligned(size_t size);
+static int       arena_init(arena_t *arena, size_t size);
+static void     *arena_alloc(arena_t *arena, size_t size);
+static fptype   *arena_alloc_1d(arena_t *arena, size_t n);
+static fptype  **arena_alloc_2d(arena_t *arena, int n);
+static size_t    arena_1d_size(size_t n);
+static size_t    arena_2d_size(int n);
+static void      arena_reset(arena_t *arena);
+static void      arena_destroy(arena_t *arena);
+static void      init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n);
+#if defined(PRINT_INPUT_MATRICES) || defined(PRINT_INTERMEDIATE_RESULTS) || \
+	defined(VERIFY_CHOLESKY_DECOMP)
+static void      write_2d_matrix(char *filename, fptype **mat, int n, output_fmt fmt);
+#endif
+static void      write_1d_matrix(char *filename, fptype *mat, int n, output_fmt fmt);
+static void      write_binary(char *filename, fptype **mat, int rows, int n,
+			bin_layout layout);
+static int       bin_open(bin_writer_t *w, char *filename, bin_layout layout,
+			int rows, int n);
+static int       bin_write(bin_writer_t *w, fptype *x, size_t count, size_t stride);
+static int       bin_flush(bin_writer_t *w);
+static int       bin_close(bin_writer_t *w);
+#ifdef PRINT_INPUT_MATRICES
+static void      print_input_matrices(void);
+#endif
+static void      solve_system(fptype **a, fptype *b, int n, sys_id sid,
+			solve_opts_t *opts, arena_t *ws);
+#ifndef FPTYPE_FLOAT
+static void      solve_system_mixed(fptype **a, fptype *b, int n, sys_id sid,
+			solve_opts_t *opts, arena_t *ws);
+static void      residual(fptype *r, fptype **a, fptype *x, fptype *b, int n);
+static fptype    matrix_norm_inf(fptype **a, int n);
+static fptype    vector_norm_inf(fptype *x, int n);
+#endif
+static void      solve_batch(fptype **a1, fptype **a2, fptype *b1, fptype *b2,
+			int n, int count, arena_t *ws);
+#ifdef OPTIMIZED
+static void      batch_cholesky_solve(fpbatch *band, fpbatch *x, int n);
+static void      batch_sqrt(fpbatch *x);
+#endif
+#ifdef OPTIMIZED
+static void      solve_system_spike(fptype **a, fptype *b, int n, sys_id sid,
+			solve_opts_t *opts, arena_t *ws);
+static int       solve_system_stream(int n, sys_id sid, solve_opts_t *opts);
+static fptype    stream_a(sys_id sid, int d);
+static fptype    stream_b(sys_id sid, int i, int n);
+static int       stream_io(int fd, fptype *buf, int nrecs, off_t first, int write);
+#ifdef PRINT_RESULTS
+static void      stream_write_x(char *filename, int fd, int n, fptype *buf,
+			output_fmt fmt);
+#endif
+static int       spike_solve(fptype **a, fptype **l, fptype *b, fptype *x, int n,
+			int nblocks);
+static void      spike_run(spike_block_t *blk, int nblocks, void *(*fn)(void *),
+			pthread_t *tids);
+static void     *spike_reduce(void *arg);
+static void     *spike_expand(void *arg);
+static fptype    spike_u(spike_block_t *blk, int i, int c);
+static fptype    spike_v(spike_block_t *blk, int i, int c);
+static void      spike_schur_solve(fptype *s, fptype *r, int q);
+static void      solve_system_toeplitz(fptype **a, fptype *b, int n, sys_id sid,
+			solve_opts_t *opts);
+static int       toeplitz_factor(toeplitz_factor_t *f, fptype **a, int n);
+static void      toeplitz_solve(toeplitz_factor_t *f, fptype *x);
+#endif
+static int       solve_system_sparse(solve_opts_t *opts);
+static void      solve_system_skyline(fptype **a, fptype *b, int n, sys_id sid,
+			solve_opts_t *opts);
+static int       skyline_run(skyline_t *sk, fptype *x, sys_id sid);
+static int       skyline_from_matrix(skyline_t *sk, fptype **a, int n);
+static int       skyline_from_csr(skyline_t *sk, csr_matrix_t *a);
+static int       skyline_alloc(skyline_t *sk);
+static int       skyline_factor(skyline_t *sk);
+static void      skyline_solve(skyline_t *sk, fptype *x);
+static void      skyline_free(skyline_t *sk);
+static int       sparse_symbolic(sparse_symbolic_t *sym, csr_matrix_t *a,
+			sparse_order order);
+static void      sparse_postorder(sparse_symbolic_t *sym, int *work);
+static int       sparse_supernodes(sparse_symbolic_t *sym, csr_matrix_t *a,
+			int *stack, int *mark);
+static int       sparse_order_nd(int *perm, csr_matrix_t *a);
+static void      nd_order(nd_work_t *w, int *seg, int cnt);
+static void      nd_dissect(nd_work_t *w, int *seg, int cnt);
+static int       nd_bfs(nd_work_t *w, int root, int label, int *depth);
+static int       sparse_ereach(sparse_symbolic_t *sym, csr_matrix_t *a, int k,
+			int *stack, int *mark);
+static int       sparse_numeric(sparse_factor_t *f, sparse_symbolic_t *sym,
+			csr_matrix_t *a);
+static void      sparse_update(sparse_factor_t *f, sparse_symbolic_t *sym,
+			int d, int s);
+static int       sparse_panel(fptype *l, int nr, int nc, fptype *buf);
+static void      sparse_block(fptype *buf, int ldbuf, const fptype *a, int lda,
+			int m, int nb, int kc);
+static void      sparse_solve(sparse_symbolic_t *sym, sparse_factor_t *f,
+			fptype *x, fptype *y);
+static void      sparse_symbolic_free(sparse_symbolic_t *sym);
+static void      sparse_factor_free(sparse_factor_t *f);
+static int       cholesky_factorize(cholesky_factor_t *f, fptype **a, int n,
+			solve_opts_t *opts, arena_t *ws);
+static double    cholesky_flops(int n);
+static void      bench_stats(bench_result_t *res, double *t, int reps);
+static int       bench_cmp(const void *a, const void *b);
+static void      cholesky_solve(cholesky_factor_t *f, fptype *bb, int k, int ldb);
+static void      cholesky_release(cholesky_factor_t *f);
+static int       server_load(cholesky_server_t *s, server_entry_t *e, int sid,
+			int n, factor_alg alg);
+static void      server_evict(server_entry_t *e);
+#ifdef USE_FACTOR_CACHE
+static uint64_t  factor_cache_key(fptype **a, int n);
+static uint64_t  fnv1a(uint64_t hash, const void *data, size_t size);
+static void      factor_cache_path(char *path, uint64_t hash);
+static int       factor_cache_load(cholesky_factor_t *f, fptype **a, uint64_t hash,
+			int n, arena_t *ws);
+static int       factor_cache_store(cholesky_factor_t *f, fptype **a, uint64_t hash);
+static int       write_full(int fd, const void *buf, size_t size);
+#endif
+static fptype  **cholesky_decomposition(fptype **a, int n, arena_t *ws);
+#ifdef OPTIMIZED
+static void      band_factor(fptype **a, fptype **l, int n);
+#endif
+static fptype  **cholesky_decomposition_tiled(fptype **a, int n, int nthreads,
+			arena_t *ws);
+#ifndef OPTIMIZED
+static void     *tile_worker(void *arg);
+static void      tile_push(tile_sched_t *s, tile_task_type type, int i, int j, int k);
+static void      tile_complete(tile_sched_t *s, tile_task_t *t);
+static void      tile_potrf(tile_sched_t *s, int k);
+static void      tile_trsm(tile_sched_t *s, int i, int k);
+static void      tile_update(tile_sched_t *s, int i, int j, int k, fptype *bt);
+static void      tile_microkernel(fptype *c, int ldc, fptype *a, int lda,
+			fptype *bt, int ldb, int kc);
+#endif
+#ifdef VERIFY_CHOLESKY_DECOMP
+static void      verify_cholesky_decomposition(fptype **l, int n, sys_id sid,
+			output_fmt fmt);
+#endif
+static void      verify_solution(fptype **a, fptype **l, fptype *b, fptype *x, int n,
+			sys_id sid);
+static int       lower_bandwidth(fptype **a, int n);
+static void      forward_substitution(fptype **l, fptype *bb, int n, int k, int ldb);
+static void      back_substitution(fptype **l, fptype *bb, int n, int k, int ldb);
+static void      block_axpy(fptype *y, fptype s, fptype *x, int w);
+static void      block_divide(fptype *y, fptype s, int w);
+static double    wall_time(void);
+static void      free_1d_matrices(int num_args, ...);
+static void      free_2d_matrices(int n, int num_args, ...);
+static void      free_2d_matrix(fptype **mat, int n);
+
+
+/*
+ * Solves A1 * x = b1 and A2 * x = b2 in this instance's precision; called
+ * by main() once the command line has been parsed.
+ */
+int PREC_NAME(cholesky_run)(int n, solve_opts_t *opts)
+{
+	int ldb;
+	size_t ws_size;
 	fptype **a1  = NULL, **a2  = NULL,
 	        *b1  = NULL,  *b2  = NULL;
+	arena_t  ws;
 #ifdef PRINT_INPUT_MATRICES
 	char filename[BUFF_SIZE];
 #endif
 
-	if (argc != 2)
-	{
-		fprintf(stderr, "Usage: %s N\t(N > 0)\n", argv[0]);
-		return EXIT_SUCCESS;
-	}
+	/* A sparse matrix read from a file replaces A1 and A2 */
+	if (opts->input)
+		return solve_system_sparse(opts);
 
-	if ((n = atoi(argv[1])) <= 0)
-	{
-		fprintf(stderr, "Matrix size (N) should be positive!\n");
-		return EXIT_SUCCESS;
-	}
-	else
-		printf("N = %d\n", n);
+#ifdef OPTIMIZED
+	/* Out of core: the rows of A and b are generated as they are needed */
+	if (opts->spill)
+		return (solve_system_stream(n, S1, opts) != 0 ||
+				solve_system_stream(n, S2, opts) != 0) ?
+				EXIT_FAILURE : EXIT_SUCCESS;
+#endif
 
 	if (alloc_1d_matrices(n, 2, &b1, &b2) != 0 ||
 			alloc_2d_matrices(n, 2, &a1, &a2))
 		return EXIT_FAILURE;
 
+	/*
+	 * Workspace for L, the right-hand side block and x, shared by both
+	 * systems; a mixed-precision solve needs x, r and a reference x instead
+	 * and a batch adds its interleaved band and right-hand sides.
+	 */
+	ldb = (opts->k > 1) ? (int) ROW_STRIDE(opts->k) : 1;
+	if (opts->mixed)
+		ws_size = 3 * arena_1d_size(n);
+	else
+		ws_size = arena_2d_size(n) + arena_1d_size((size_t) n * ldb) + arena_1d_size(n);
+	if (opts->batch > 0)
+		ws_size += (NUM_ROWS(n) + 1) * n * sizeof(fpbatch) + ALIGNMENT;
+	if (arena_init(&ws, ws_size) != 0)
+		return EXIT_FAILURE;
+
 	/* Initialize matrices */
 	init_matrices(a1, a2, b1, b2, n);
 
@@ -98,9 +595,15 @@ int main(int argc, char **argv)
 	print_input_matrices();
 #endif
 
-	solve_system(a1, b1, n, S1);
-	solve_system(a2, b2, n, S2);
+	if (opts->batch > 0)
+		solve_batch(a1, a2, b1, b2, n, opts->batch, &ws);
+	else
+	{
+		solve_system(a1, b1, n, S1, opts, &ws);
+		solve_system(a2, b2, n, S2, opts, &ws);
+	}
 
+	arena_destroy(&ws);
 	free_2d_matrices(n, 2, a1, a2);
 	free_1d_matrices(2, b1, b2);
 
@@ -108,7 +611,7 @@ int main(int argc, char **argv)
 }
 
 
-int alloc_1d_matrices(int n, int num_args, ...)
+static int alloc_1d_matrices(int n, int num_args, ...)
 {
 	va_list args;
 	fptype ***ptr;
@@ -139,7 +642,7 @@ int alloc_1d_matrices(int n, int num_args, ...)
 }
 
 
-int alloc_2d_matrices(int n, int num_args, ...)
+static int alloc_2d_matrices(int n, int num_args, ...)
 {
 	va_list args;
 	fptype ****ptr;
@@ -170,10 +673,11 @@ int alloc_2d_matrices(int n, int num_args, ...)
 }
 
 
-fptype **alloc_2d_matrix(int n)
+static fptype **alloc_2d_matrix(int n)
 {
-	int i, j;
-	fptype **mat = (fptype **) malloc(n * sizeof(fptype *));
+	int i;
+	size_t stride = ROW_STRIDE(n);
+	fptype **mat = (fptype **) malloc(NUM_ROWS(n) * sizeof(fptype *));
 
 	if (!mat)
 	{
@@ -181,39 +685,150 @@ fptype **alloc_2d_matrix(int n)
 		return NULL;
 	}
 
-	for (i = 0; i < n; i++)
+	/* All rows live in a single contiguous block */
+	mat[0] = (fptype *) alloc_aligned(NUM_ROWS(n) * stride * sizeof(fptype));
+	if (!mat[0])
 	{
-		mat[i] = (fptype *) calloc(n, sizeof(fptype));
-		if (!mat[i])
-		{
-			perror("calloc");
-			for (j = 0; j < i; j++)
-				free(mat[j]);
-			free(mat);
-			return NULL;
-		}
+		free(mat);
+		return NULL;
 	}
+	for (i = 1; i < NUM_ROWS(n); i++)
+		mat[i] = mat[i-1] + stride;
 	return mat;
 }
 
 
-fptype *alloc_1d_matrix(int n)
+static fptype *alloc_1d_matrix(int n)
 {
-	fptype *mat = (fptype *) calloc(n, sizeof(fptype));
+	return (fptype *) alloc_aligned(n * sizeof(fptype));
+}
 
-	if (!mat)
+
+/*
+ * Returns a zeroed block of (at least) size bytes that is aligned to
+ * ALIGNMENT bytes. If USE_HUGE_PAGES is defined, blocks spanning at least
+ * one huge page are aligned to HUGE_PAGE_SIZE and backed by transparent
+ * huge pages where the kernel supports it.
+ */
+static void *alloc_aligned(size_t size)
+{
+	void *ptr;
+	size_t alignment = ALIGNMENT;
+	int err;
+
+	size = (size + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+	if (size == 0)
+		size = ALIGNMENT;
+#ifdef USE_HUGE_PAGES
+	if (size >= HUGE_PAGE_SIZE)
 	{
-		perror("calloc");
+		alignment = HUGE_PAGE_SIZE;
+		size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	}
+#endif
+
+	if ((err = posix_memalign(&ptr, alignment, size)) != 0)
+	{
+		errno = err;
+		perror("posix_memalign");
+		return NULL;
+	}
+#if defined(USE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+	if (alignment == HUGE_PAGE_SIZE)
+		madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+
+static int arena_init(arena_t *arena, size_t size)
+{
+	arena->used = 0;
+	arena->size = (size + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+	if (!(arena->base = (char *) alloc_aligned(arena->size)))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+
+/* Returns a zeroed, ALIGNMENT-aligned chunk of the arena */
+static void *arena_alloc(arena_t *arena, size_t size)
+{
+	void *ptr;
+
+	size = (size + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+	if (size > arena->size - arena->used)
+	{
+		fprintf(stderr, "arena_alloc: workspace exhausted (%zu bytes "
+				"requested, %zu available)\n", size,
+				arena->size - arena->used);
 		return NULL;
 	}
+	ptr = arena->base + arena->used;
+	arena->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+
+static fptype *arena_alloc_1d(arena_t *arena, size_t n)
+{
+	return (fptype *) arena_alloc(arena, n * sizeof(fptype));
+}
+
+
+static fptype **arena_alloc_2d(arena_t *arena, int n)
+{
+	int i;
+	size_t stride = ROW_STRIDE(n);
+	fptype **mat;
 
+	if (!(mat = (fptype **) arena_alloc(arena, NUM_ROWS(n) * sizeof(fptype *))))
+		return NULL;
+	if (!(mat[0] = (fptype *) arena_alloc(arena, NUM_ROWS(n) * stride * sizeof(fptype))))
+		return NULL;
+	for (i = 1; i < NUM_ROWS(n); i++)
+		mat[i] = mat[i-1] + stride;
 	return mat;
 }
 
 
-void init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n)
+/* Arena bytes needed by arena_alloc_1d(arena, n) */
+static size_t arena_1d_size(size_t n)
 {
-	int i, j;
+	return (n * sizeof(fptype) + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+}
+
+
+/* Arena bytes needed by arena_alloc_2d(arena, n) */
+static size_t arena_2d_size(int n)
+{
+	return ((NUM_ROWS(n) * sizeof(fptype *) + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1)) +
+			NUM_ROWS(n) * ROW_STRIDE(n) * sizeof(fptype);
+}
+
+
+static void arena_reset(arena_t *arena)
+{
+	arena->used = 0;
+}
+
+
+static void arena_destroy(arena_t *arena)
+{
+	free(arena->base);
+	arena->base = NULL;
+	arena->size = arena->used = 0;
+}
+
+
+static void init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n)
+{
+	int i;
+#ifndef OPTIMIZED
+	int j;
+#endif
 
 	/* Init b1 */
 	b1[0] = b1[n-1] = 3;
@@ -225,6 +840,17 @@ void init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n)
 		b2[i] = 1;
 
 	/* Init a1, a2 */
+#ifdef OPTIMIZED
+	for (i = 0; i < n; i++)
+	{
+		a1[0][i] = 6;
+		a2[0][i] = 7;
+		if (i >= 1)
+			a1[1][i] = a2[1][i] = -4;
+		if (i >= 2)
+			a1[2][i] = a2[2][i] = 1;
+	}
+#else
 	for (i = 0; i < n; i++)
 	{
 		for (j = 0; j < n; j++)
@@ -240,14 +866,27 @@ void init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n)
 				a1[i][j] = a2[i][j] = 1;
 		}
 	}
+#endif
 }
 
 
-void write_2d_matrix(char *filename, fptype **mat, int n)
+#if defined(PRINT_INPUT_MATRICES) || defined(PRINT_INTERMEDIATE_RESULTS) || \
+	defined(VERIFY_CHOLESKY_DECOMP)
+static void write_2d_matrix(char *filename, fptype **mat, int n, output_fmt fmt)
 {
 	int i, j;
 	FILE *outfile;
 
+	if (fmt == OUT_BINARY)
+	{
+#ifdef OPTIMIZED
+		write_binary(filename, mat, NUM_ROWS(n), n, BIN_BAND);
+#else
+		write_binary(filename, mat, NUM_ROWS(n), n, BIN_DENSE);
+#endif
+		return;
+	}
+
 #ifdef PRINT_TOFILE
 	outfile = fopen(filename, "w");
 	if (!outfile)
@@ -259,10 +898,10 @@ void write_2d_matrix(char *filename, fptype **mat, int n)
 	outfile = stdout;
 #endif
 
-	for (i = 0; i < n; i++)
+	for (i = 0; i < NUM_ROWS(n); i++)
 	{
 		for (j = 0; j < n; j++)
-			fprintf(outfile, "%10f  ", mat[i][j]);
+			fprintf(outfile, "%10f  ", (double) mat[i][j]);
 		fprintf(outfile, "\n");
 	}
 
@@ -270,13 +909,20 @@ void write_2d_matrix(char *filename, fptype **mat, int n)
 	fclose(outfile);
 #endif
 }
+#endif
 
 
-void write_1d_matrix(char *filename, fptype *mat, int n)
+static void write_1d_matrix(char *filename, fptype *mat, int n, output_fmt fmt)
 {
 	int i;
 	FILE *outfile;
 
+	if (fmt == OUT_BINARY)
+	{
+		write_binary(filename, &mat, 1, n, BIN_VECTOR);
+		return;
+	}
+
 #ifdef PRINT_TOFILE
 	outfile = fopen(filename, "w");
 	if (!outfile)
@@ -289,7 +935,7 @@ void write_1d_matrix(char *filename, fptype *mat, int n)
 #endif
 
 	for (i = 0; i < n; i++)
-		fprintf(outfile, "%10f\n", mat[i]);
+		fprintf(outfile, "%10f\n", (double) mat[i]);
 
 #ifdef PRINT_TOFILE
 	fclose(outfile);
@@ -297,154 +943,3286 @@ void write_1d_matrix(char *filename, fptype *mat, int n)
 }
 
 
+/*
+ * Binary counterpart of write_1d_matrix() and write_2d_matrix(): the rows
+ * rows of mat go to filename with its extension replaced by BIN_EXT, in
+ * the format of binfmt.h.
+ */
+static void write_binary(char *filename, fptype **mat, int rows, int n, bin_layout layout)
+{
+	int i;
+	bin_writer_t w;
+
+	if (bin_open(&w, filename, layout, rows, n) != 0)
+		return;
+	for (i = 0; i < rows; i++)
+		if (bin_write(&w, mat[i], n, 1) != 0)
+			break;
+	bin_close(&w);
+}
+
+
+static int bin_open(bin_writer_t *w, char *filename, bin_layout layout, int rows, int n)
+{
+	char path[BUFF_SIZE + sizeof(BIN_EXT)], *dot;
+	bin_hdr_t hdr;
+
+	/* x1_10.txt is written as x1_10.bin */
+	snprintf(path, BUFF_SIZE, "%s", filename);
+	if ((dot = strrchr(path, '.')))
+		*dot = '\0';
+	strcat(path, BIN_EXT);
+
+	if (!(w->buf = (unsigned char *) alloc_aligned(BIN_CHUNK)))
+		return EXIT_FAILURE;
+	if ((w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		perror("open");
+		free(w->buf);
+		return EXIT_FAILURE;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version   = htole32(BIN_VERSION);
+	hdr.elem_size = htole32(sizeof(fptype));
+	hdr.mant_dig  = htole32(FP_MANT_DIG);
+	hdr.layout    = htole32(layout);
+	hdr.rows      = htole64(rows);
+	hdr.n         = htole64(n);
+	memcpy(w->buf, &hdr, sizeof(hdr));
+	w->used = BIN_HDR_SIZE;
+	return EXIT_SUCCESS;
+}
+
+
+/* Appends count elements, x[0], x[stride], x[2*stride] and so on */
+static int bin_write(bin_writer_t *w, fptype *x, size_t count, size_t stride)
+{
+	size_t i, m;
+	unsigned char *p;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	size_t j;
+	unsigned char c;
+#endif
+
+	while (count > 0)
+	{
+		if (w->used == BIN_CHUNK && bin_flush(w) != 0)
+			return EXIT_FAILURE;
+		m = (BIN_CHUNK - w->used) / sizeof(fptype);
+		if (m > count)
+			m = count;
+		p = w->buf + w->used;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (stride == 1 && FP_VALUE_BYTES == sizeof(fptype))
+			memcpy(p, x, m * sizeof(fptype));
+		else
+#endif
+		{
+			for (i = 0; i < m; i++, p += sizeof(fptype))
+			{
+				memset(p, 0, sizeof(fptype));
+				memcpy(p, &x[i*stride], FP_VALUE_BYTES);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				for (j = 0; j < sizeof(fptype) / 2; j++)
+				{
+					c = p[j];
+					p[j] = p[sizeof(fptype)-1-j];
+					p[sizeof(fptype)-1-j] = c;
+				}
+#endif
+			}
+		}
+		w->used += m * sizeof(fptype);
+		x += m * stride;
+		count -= m;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int bin_flush(bin_writer_t *w)
+{
+	unsigned char *p = w->buf;
+	ssize_t ret;
+
+	while (w->used > 0)
+	{
+		if ((ret = write(w->fd, p, w->used)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return EXIT_FAILURE;
+		}
+		p += ret;
+		w->used -= ret;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int bin_close(bin_writer_t *w)
+{
+	int ret = bin_flush(w);
+
+	if (close(w->fd) != 0)
+	{
+		perror("close");
+		ret = EXIT_FAILURE;
+	}
+	free(w->buf);
+	return ret;
+}
+
 #ifdef PRINT_INPUT_MATRICES
-void print_input_matrices(void)
+static void print_input_matrices(void)
 {
 	#ifndef PRINT_TOFILE
 	printf("\nWriting A1...\n");
 	#endif
 	snprintf(filename, BUFF_SIZE, "a1_%d.txt", n);
-	write_2d_matrix(filename, a1, n);
+	write_2d_matrix(filename, a1, n, opts->out);
 
 	#ifndef PRINT_TOFILE
 	printf("\nWriting A2...\n");
 	#endif
 	snprintf(filename, BUFF_SIZE, "a2_%d.txt", n);
-	write_2d_matrix(filename, a2, n);
+	write_2d_matrix(filename, a2, n, opts->out);
 
 	#ifndef PRINT_TOFILE
 	printf("\nWriting B1...\n");
 	#endif
 	snprintf(filename, BUFF_SIZE, "b1_%d.txt", n);
-	write_1d_matrix(filename, b1, n);
+	write_1d_matrix(filename, b1, n, opts->out);
 
 	#ifndef PRINT_TOFILE
 	printf("\nWriting B2...\n");
 	#endif
 	snprintf(filename, BUFF_SIZE, "b2_%d.txt", n);
-	write_1d_matrix(filename, b2, n);
+	write_1d_matrix(filename, b2, n, opts->out);
 }
 #endif
 
 
-void solve_system(fptype **a, fptype *b, int n, sys_id sid)
+/*
+ * Solves A * X = B, where every one of the k columns of B is b. A is
+ * factored once and all k right-hand sides are swept as one block.
+ */
+static void solve_system(fptype **a, fptype *b, int n, sys_id sid, solve_opts_t *opts,
+		arena_t *ws)
 {
-	fptype **l, **l_trn, *y, *x;
+	int i, j, k = opts->k, ldb = (k > 1) ? (int) ROW_STRIDE(k) : 1;
+	fptype *bb, *x;
+	cholesky_factor_t f;
+	double t0, t1, t2;
 #if defined(PRINT_INTERMEDIATE_RESULTS) || defined(PRINT_RESULTS)
 	char filename[BUFF_SIZE];
 #endif
 
-	if (!(l = cholesky_decomposition(a, n)))
-		return;
+	TRACE_SCOPE("solve_system");
 
-#ifdef VERIFY_CHOLESKY_DECOMP
-	verify_cholesky_decomposition(l, n, sid);
+#ifndef FPTYPE_FLOAT
+	if (opts->mixed)
+	{
+		solve_system_mixed(a, b, n, sid, opts, ws);
+		return;
+	}
 #endif
-
-	/* L * y = b, solve for y */
-	if (!(y = forward_substitution(l, b, n)))
+#ifdef OPTIMIZED
+	if (opts->alg == ALG_SPIKE)
 	{
-		free_2d_matrix(l, n);
+		solve_system_spike(a, b, n, sid, opts, ws);
 		return;
 	}
-
-	/* Calculate transpose of matrix l */
-	if (!(l_trn = transpose(l, n)))
+	if (opts->alg == ALG_TOEPLITZ)
 	{
-		free_2d_matrix(l, n);
-		free(y);
+		solve_system_toeplitz(a, b, n, sid, opts);
 		return;
 	}
-
-	/* L^T * x = y, solve for x */
-	if (!(x = back_substitution(l_trn, y, n)))
+#endif
+	if (opts->alg == ALG_SKYLINE)
 	{
-		free_2d_matrices(n, 2, l, l_trn);
-		free(y);
+		solve_system_skyline(a, b, n, sid, opts);
 		return;
 	}
 
-#ifdef PRINT_INTERMEDIATE_RESULTS
-	#ifndef PRINT_TOFILE
-	printf("\nWriting L%d...\n", sid);
-	#endif
-	snprintf(filename, BUFF_SIZE, "l%1d_%d.txt", sid, n);
-	write_2d_matrix(filename, l, n);
+	/* L, B and x are drawn from ws; whatever the previous call left is reused */
+	arena_reset(ws);
+	if (!(bb = arena_alloc_1d(ws, (size_t) n * ldb)) || !(x = arena_alloc_1d(ws, n)))
+		return;
+	for (i = 0; i < n; i++)
+		for (j = 0; j < k; j++)
+			bb[(size_t) i*ldb + j] = b[i];
 
-	#ifndef PRINT_TOFILE
-	printf("\nWriting L%d^T...\n", sid);
+	t0 = wall_time();
+	if (cholesky_factorize(&f, a, n, opts, ws) != 0)
+		return;
+	t1 = wall_time();
+
+#ifdef VERIFY_CHOLESKY_DECOMP
+	verify_cholesky_decomposition(f.l, n, sid, opts->out);
+#endif
+
+#ifdef PRINT_INTERMEDIATE_RESULTS
+	/* L * y = b, solve for y (first right-hand side only) */
+	for (i = 0; i < n; i++)
+		x[i] = bb[(size_t) i*ldb];
+	forward_substitution(f.l, x, n, 1, 1);
+
+	#ifndef PRINT_TOFILE
+	printf("\nWriting L%d...\n", sid);
 	#endif
-	snprintf(filename, BUFF_SIZE, "lt%1d_%d.txt", sid, n);
-	write_2d_matrix(filename, l_trn, n);
+	snprintf(filename, BUFF_SIZE, "l%1d_%d.txt", sid, n);
+	write_2d_matrix(filename, f.l, n, opts->out);
 
 	#ifndef PRINT_TOFILE
 	printf("\nWriting Y%d...\n", sid);
 	#endif
 	snprintf(filename, BUFF_SIZE, "y%1d_%d.txt", sid, n);
-	write_1d_matrix(filename, y, n);
+	write_1d_matrix(filename, x, n, opts->out);
+#endif
+
+	/* A * X = B, i.e. L * Y = B and L^T * X = Y, solve for X (in place) */
+	cholesky_solve(&f, bb, k, ldb);
+	t2 = wall_time();
+
+	for (i = 0; i < n; i++)
+		x[i] = bb[(size_t) i*ldb];
+
+	if (k > 1 || opts->alg != ALG_ROW)
+		printf("\nSystem %d: factorization %.6f s (%.3f GFLOP/s), "
+				"%d solves %.6f s\n", sid, t1 - t0,
+				cholesky_flops(n) / (t1 - t0) * 1e-9, k, t2 - t1);
+	if (opts->verify)
+		verify_solution(a, f.l, b, x, n, sid);
+
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+	printf("\nWriting X%d...\n", sid);
+	#endif
+	snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
+	write_1d_matrix(filename, x, n, opts->out);
+#endif
+
+	cholesky_release(&f);
+}
+
+
+#ifndef FPTYPE_FLOAT
+/*
+ * Mixed-precision solve of A * x = b: A is rounded to float, factored and
+ * swept in float, while x and the residual r = b - A * x are kept in
+ * fptype. Every step solves A * d = r with the float factor and adds d to
+ * x, until the backward error is at the level of fptype. A solve entirely
+ * in fptype is timed alongside; its x is printed instead if the float
+ * factor breaks down or the refinement stops converging.
+ */
+static void solve_system_mixed(fptype **a, fptype *b, int n, sys_id sid, solve_opts_t *opts,
+		arena_t *ws)
+{
+	int i, j, steps, converged = 0;
+	float **a_lo = NULL, *d = NULL;
+	cholesky_handle_f *h_lo = NULL;
+	cholesky_handle_t *h = NULL;
+	fptype *x, *r, *x_ref, anorm, rnorm, xnorm, prev_rnorm = INFINITY;
+	double t0, t1, t2;
+#ifdef PRINT_RESULTS
+	char filename[BUFF_SIZE];
+#endif
+
+	arena_reset(ws);
+	if (!(x = arena_alloc_1d(ws, n)) || !(r = arena_alloc_1d(ws, n)) ||
+			!(x_ref = arena_alloc_1d(ws, n)))
+		return;
+	if (!(a_lo = cholesky_matrix_alloc_f(n)))
+		return;
+	if (!(d = (float *) malloc(n * sizeof(float))))
+	{
+		perror("malloc");
+		goto out;
+	}
+
+	t0 = wall_time();
+	for (i = 0; i < NUM_ROWS(n); i++)
+		for (j = 0; j < n; j++)
+			a_lo[i][j] = (float) a[i][j];
+	if (!(h_lo = cholesky_factor_create_f(a_lo, n, opts)))
+		goto out;
+
+	/* x = 0, so the first step solves A * d = b */
+	anorm = matrix_norm_inf(a, n);
+	memcpy(r, b, n * sizeof(fptype));
+	for (steps = 1; steps <= MAX_REFINE_STEPS; steps++)
+	{
+		for (i = 0; i < n; i++)
+			d[i] = (float) r[i];
+		cholesky_factor_solve_f(h_lo, d, 1, 1);
+		for (i = 0; i < n; i++)
+			x[i] += d[i];
+
+		residual(r, a, x, b, n);
+		rnorm = vector_norm_inf(r, n);
+		xnorm = vector_norm_inf(x, n);
+		/* Stops on Inf/NaN too, e.g. when A is not positive definite in float */
+		if (!isfinite(rnorm) || !isfinite(xnorm))
+			break;
+		if (rnorm <= xnorm * anorm * FP_EPSILON * FP_SQRT((fptype) n))
+		{
+			converged = 1;
+			break;
+		}
+		if (rnorm >= prev_rnorm)
+			break;
+		prev_rnorm = rnorm;
+	}
+	t1 = wall_time();
+
+	/* Reference: factor and solve in fptype */
+	if (!(h = PREC_NAME(cholesky_factor_create)(a, n, opts)))
+		goto out;
+	memcpy(x_ref, b, n * sizeof(fptype));
+	PREC_NAME(cholesky_factor_solve)(h, x_ref, 1, 1);
+	t2 = wall_time();
+
+	if (converged)
+		printf("\nSystem %d: mixed precision converged after %d refinement "
+				"steps, %.6f s (%s: %.6f s)\n", sid, steps, t1 - t0,
+				FP_NAME, t2 - t1);
+	else
+	{
+		printf("\nSystem %d: mixed precision did not converge, %.6f s; "
+				"using the %s solve (%.6f s)\n", sid, t1 - t0,
+				FP_NAME, t2 - t1);
+		x = x_ref;
+	}
+
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+	printf("\nWriting X%d...\n", sid);
+	#endif
+	snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
+	write_1d_matrix(filename, x, n, opts->out);
+#endif
+
+out:
+	PREC_NAME(cholesky_factor_destroy)(h);
+	cholesky_factor_destroy_f(h_lo);
+	cholesky_matrix_free_f(a_lo, n);
+	free(d);
+}
+
+
+/* r = b - A * x, with A symmetric in the storage of the build */
+static void residual(fptype *r, fptype **a, fptype *x, fptype *b, int n)
+{
+	int i, j;
+	fptype sum;
+
+	for (i = 0; i < n; i++)
+	{
+		sum = b[i];
+#ifdef OPTIMIZED
+		sum -= a[0][i] * x[i];
+		for (j = 1; j <= BANDWIDTH; j++)
+		{
+			if (i-j >= 0)
+				sum -= a[j][i] * x[i-j];
+			if (i+j < n)
+				sum -= a[j][i+j] * x[i+j];
+		}
+#else
+		for (j = 0; j < n; j++)
+			sum -= a[i][j] * x[j];
+#endif
+		r[i] = sum;
+	}
+}
+
+
+/* Largest absolute row sum of the symmetric matrix A */
+static fptype matrix_norm_inf(fptype **a, int n)
+{
+	int i, j;
+	fptype sum, norm = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		sum = 0;
+#ifdef OPTIMIZED
+		sum += FP_ABS(a[0][i]);
+		for (j = 1; j <= BANDWIDTH; j++)
+		{
+			if (i-j >= 0)
+				sum += FP_ABS(a[j][i]);
+			if (i+j < n)
+				sum += FP_ABS(a[j][i+j]);
+		}
+#else
+		for (j = 0; j < n; j++)
+			sum += FP_ABS(a[i][j]);
+#endif
+		if (sum > norm)
+			norm = sum;
+	}
+	return norm;
+}
+
+
+/* Largest absolute element of x; NaN if x holds a NaN */
+static fptype vector_norm_inf(fptype *x, int n)
+{
+	int i;
+	fptype norm = 0;
+
+	for (i = 0; i < n; i++)
+		if (FP_ABS(x[i]) > norm || isnan(x[i]))
+			norm = FP_ABS(x[i]);
+	return norm;
+}
+#endif
+
+
+#ifdef OPTIMIZED
+/*
+ * Out-of-core solve of A * x = b: the rows of A and b are generated one at
+ * a time, the matching row of L is computed from the last BANDWIDTH ones
+ * and forward substitution runs in the same pass; finished rows of L and
+ * y are spilled to opts->spill. Back substitution then streams the file in
+ * reverse, writing x over y. Only STREAM_CHUNK rows are ever in memory,
+ * so n is bounded by disk space only. Operations are done in the order of
+ * the in-core solver, which gives the same x.
+ */
+static int solve_system_stream(int n, sys_id sid, solve_opts_t *opts)
+{
+	int fd, i, j, k, d, lo, hi, ret = EXIT_FAILURE;
+	fptype *buf, *cur, *ring[BANDWIDTH+1], sum;
+	double t0, t1, t2;
+#ifdef PRINT_RESULTS
+	char filename[BUFF_SIZE];
+#endif
+
+	TRACE_SCOPE("solve_system_stream");
+
+	if (!(buf = (fptype *) alloc_aligned((STREAM_CHUNK + BANDWIDTH + 1) *
+					STREAM_REC * sizeof(fptype))))
+		return EXIT_FAILURE;
+	/* Copies of the last BANDWIDTH+1 records live past the chunk */
+	for (d = 0; d <= BANDWIDTH; d++)
+		ring[d] = buf + (size_t) (STREAM_CHUNK + d) * STREAM_REC;
+	if ((fd = open(opts->spill, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+	{
+		perror("open");
+		free(buf);
+		return EXIT_FAILURE;
+	}
+
+	t0 = wall_time();
+	for (lo = 0; lo < n; lo = hi)
+	{
+		hi = (n - lo < STREAM_CHUNK) ? n : lo + STREAM_CHUNK;
+		for (i = lo; i < hi; i++)
+		{
+			cur = ring[i % (BANDWIDTH+1)];
+			memset(cur, 0, STREAM_REC * sizeof(fptype));
+			for (j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; j < i; j++)
+			{
+				sum = 0.0;
+				for (k = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; k < j; k++)
+					sum += cur[i-k] * ring[j % (BANDWIDTH+1)][j-k];
+				cur[i-j] = (stream_a(sid, i-j) - sum) /
+						ring[j % (BANDWIDTH+1)][0];
+			}
+			sum = 0.0;
+			for (j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; j < i; j++)
+				sum += cur[i-j] * cur[i-j];
+			cur[0] = FP_SQRT(stream_a(sid, 0) - sum);
+
+			/* L * y = b */
+			cur[STREAM_REC-1] = stream_b(sid, i, n);
+			for (j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; j < i; j++)
+				cur[STREAM_REC-1] += -cur[i-j] *
+						ring[j % (BANDWIDTH+1)][STREAM_REC-1];
+			cur[STREAM_REC-1] /= cur[0];
+			memcpy(buf + (size_t) (i-lo) * STREAM_REC, cur,
+					STREAM_REC * sizeof(fptype));
+		}
+		if (stream_io(fd, buf, hi - lo, lo, 1) != 0)
+			goto out;
+	}
+	t1 = wall_time();
+
+	/* L^T * x = y, from the last chunk to the first */
+	for (hi = n; hi > 0; hi = lo)
+	{
+		lo = (hi < STREAM_CHUNK) ? 0 : hi - STREAM_CHUNK;
+		if (stream_io(fd, buf, hi - lo, lo, 0) != 0)
+			goto out;
+		for (i = hi-1; i >= lo; i--)
+		{
+			cur = ring[i % (BANDWIDTH+1)];
+			memcpy(cur, buf + (size_t) (i-lo) * STREAM_REC,
+					STREAM_REC * sizeof(fptype));
+			for (j = (i+BANDWIDTH < n) ? i+BANDWIDTH : n-1; j > i; j--)
+				cur[STREAM_REC-1] += -ring[j % (BANDWIDTH+1)][j-i] *
+						ring[j % (BANDWIDTH+1)][STREAM_REC-1];
+			cur[STREAM_REC-1] /= cur[0];
+			buf[(size_t) (i-lo) * STREAM_REC + STREAM_REC-1] = cur[STREAM_REC-1];
+		}
+		if (stream_io(fd, buf, hi - lo, lo, 1) != 0)
+			goto out;
+	}
+	t2 = wall_time();
+
+	printf("\nSystem %d: out of core, factorization and forward substitution "
+			"%.6f s, back substitution %.6f s\n", sid, t1 - t0, t2 - t1);
+
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+	printf("\nWriting X%d...\n", sid);
+	#endif
+	snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
+	stream_write_x(filename, fd, n, buf, opts->out);
+#endif
+	ret = EXIT_SUCCESS;
+out:
+	close(fd);
+	unlink(opts->spill);
+	free(buf);
+	return ret;
+}
+
+
+/* Element A(i,i-d) of system sid, for any row i, as init_matrices() sets it */
+static fptype stream_a(sys_id sid, int d)
+{
+	if (d == 0)
+		return (sid == S1) ? 6 : 7;
+	return (d == 1) ? -4 : 1;
+}
+
+
+/* Element i of b of system sid, as init_matrices() sets it */
+static fptype stream_b(sys_id sid, int i, int n)
+{
+	if (sid == S1)
+		return (i == 1 || i == n-2) ? -1 : (i == 0 || i == n-1) ? 3 : 0;
+	return (i >= 2 && i < n-2) ? 1 : (i == 0 || i == n-1) ? 4 : 0;
+}
+
+
+/* Reads or writes nrecs records of the spill file, starting at record first */
+static int stream_io(int fd, fptype *buf, int nrecs, off_t first, int write)
+{
+	char *p = (char *) buf;
+	size_t size = (size_t) nrecs * STREAM_REC * sizeof(fptype);
+	off_t off = first * STREAM_REC * (off_t) sizeof(fptype);
+	ssize_t ret;
+
+	while (size > 0)
+	{
+		ret = write ? pwrite(fd, p, size, off) : pread(fd, p, size, off);
+		if (ret <= 0)
+		{
+			if (ret < 0 && errno == EINTR)
+				continue;
+			perror(write ? "pwrite" : "pread");
+			return EXIT_FAILURE;
+		}
+		p += ret;
+		off += ret;
+		size -= ret;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+#ifdef PRINT_RESULTS
+/* write_1d_matrix() for the x column of the spill file */
+static void stream_write_x(char *filename, int fd, int n, fptype *buf,
+		output_fmt fmt)
+{
+	int i, lo, hi;
+	FILE *outfile;
+	bin_writer_t w;
+
+	if (fmt == OUT_BINARY)
+	{
+		if (bin_open(&w, filename, BIN_VECTOR, 1, n) != 0)
+			return;
+		for (lo = 0; lo < n; lo = hi)
+		{
+			hi = (n - lo < STREAM_CHUNK) ? n : lo + STREAM_CHUNK;
+			if (stream_io(fd, buf, hi - lo, lo, 0) != 0 ||
+					bin_write(&w, buf + STREAM_REC-1, hi - lo,
+						STREAM_REC) != 0)
+				break;
+		}
+		bin_close(&w);
+		return;
+	}
+
+#ifdef PRINT_TOFILE
+	outfile = fopen(filename, "w");
+	if (!outfile)
+	{
+		perror("fopen");
+		return;
+	}
+#else
+	outfile = stdout;
+#endif
+
+	for (lo = 0; lo < n; lo = hi)
+	{
+		hi = (n - lo < STREAM_CHUNK) ? n : lo + STREAM_CHUNK;
+		if (stream_io(fd, buf, hi - lo, lo, 0) != 0)
+			break;
+		for (i = lo; i < hi; i++)
+			fprintf(outfile, "%10f\n",
+					(double) buf[(size_t) (i-lo) * STREAM_REC + STREAM_REC-1]);
+	}
+
+#ifdef PRINT_TOFILE
+	fclose(outfile);
+#endif
+}
+#endif
+
+
+/*
+ * Solves A * x = b with the compressed factor of toeplitz_factor(), for a
+ * band A whose rows are constant after a prefix, such as A1 and A2.
+ */
+static void solve_system_toeplitz(fptype **a, fptype *b, int n, sys_id sid,
+		solve_opts_t *opts)
+{
+	toeplitz_factor_t f;
+	fptype *x;
+	double t0, t1, t2;
+#ifdef PRINT_RESULTS
+	char filename[BUFF_SIZE];
+#endif
+
+	TRACE_SCOPE("solve_system_toeplitz");
+
+	if (!(x = alloc_1d_matrix(n)))
+		return;
+	memcpy(x, b, n * sizeof(fptype));
+
+	t0 = wall_time();
+	if (toeplitz_factor(&f, a, n) != 0)
+	{
+		fprintf(stderr, "System %d: matrix is not positive definite\n", sid);
+		free(x);
+		return;
+	}
+	t1 = wall_time();
+	toeplitz_solve(&f, x);
+	t2 = wall_time();
+
+	if (f.rows < n)
+		printf("\nSystem %d: rows of L constant after row %d (%d of %d rows stored), "
+				"factorization %.6f s, solve %.6f s\n", sid, f.rows - 1,
+				f.rows, n, t1 - t0, t2 - t1);
+	else
+		printf("\nSystem %d: rows of L did not converge (all %d rows stored), "
+				"factorization %.6f s, solve %.6f s\n", sid, n, t1 - t0, t2 - t1);
+
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+	printf("\nWriting X%d...\n", sid);
+	#endif
+	snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
+	write_1d_matrix(filename, x, n, opts->out);
+#endif
+	free(f.l);
+	free(x);
+}
+
+
+/*
+ * Band factorization that stops once the rows of L repeat: when
+ * TOEPLITZ_RUN consecutive rows agree to TOEPLITZ_ULPS units in the last
+ * place and A is constant from there on, every later row of L would be
+ * the last one computed, which is kept as the limit row. Row i of L is
+ * f->l + i * (BANDWIDTH+1), element (i, i-d) at offset d; rows past the
+ * prefix have no storage. The buffer doubles as rows are added, so a
+ * matrix that never converges costs the storage of the full band.
+ */
+static int toeplitz_factor(toeplitz_factor_t *f, fptype **a, int n)
+{
+	int i, j, k, d, lo, tail, run = 0, cap = 64;
+	fptype sum, *li, *lj, *tmp;
+
+	TRACE_SCOPE("toeplitz_factor");
+
+	f->n = n;
+	/* Rows [tail, n) of A are all the same */
+	for (tail = n - 1; tail > BANDWIDTH; tail--)
+	{
+		for (d = 0; d <= BANDWIDTH; d++)
+			if (a[d][tail] != a[d][tail-1])
+				break;
+		if (d <= BANDWIDTH)
+			break;
+	}
+
+	if (!(f->l = (fptype *) malloc(cap * (BANDWIDTH+1) * sizeof(fptype))))
+	{
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (i == cap)
+		{
+			cap = (2*cap < n) ? 2*cap : n;
+			if (!(tmp = (fptype *) realloc(f->l, cap * (BANDWIDTH+1) * sizeof(fptype))))
+			{
+				perror("realloc");
+				free(f->l);
+				return EXIT_FAILURE;
+			}
+			f->l = tmp;
+		}
+		/* As in band_factor(), with row j of L at f->l + j * (BANDWIDTH+1) */
+		li = f->l + (size_t) i * (BANDWIDTH+1);
+		lo = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0;
+		for (d = i - lo + 1; d <= BANDWIDTH; d++)
+			li[d] = 0;
+		for (j = lo; j < i; j++)
+		{
+			lj = f->l + (size_t) j * (BANDWIDTH+1);
+			for (k = lo, sum = 0.0; k < j; k++)
+				sum += li[i-k] * lj[j-k];
+			li[i-j] = (a[i-j][i] - sum) / lj[0];
+		}
+		for (j = lo, sum = 0.0; j < i; j++)
+			sum += li[i-j] * li[i-j];
+		if (!(a[0][i] - sum > 0))
+		{
+			free(f->l);
+			return EXIT_FAILURE;
+		}
+		li[0] = FP_SQRT(a[0][i] - sum);
+
+		if (i > tail && i >= BANDWIDTH)
+		{
+			for (d = 0; d <= BANDWIDTH; d++)
+				if (FP_ABS(li[d] - li[d - (BANDWIDTH+1)]) >
+						TOEPLITZ_ULPS * FP_EPSILON * FP_ABS(li[d]))
+					break;
+			run = (d > BANDWIDTH) ? run + 1 : 0;
+			if (run == TOEPLITZ_RUN)
+			{
+				f->rows = i + 1;
+				return EXIT_SUCCESS;
+			}
+		}
+	}
+	f->rows = n;
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * L * y = b and L^T * x = y in place, in the order of forward_substitution()
+ * and back_substitution(); row i of L is the limit row for i >= rows.
+ */
+static void toeplitz_solve(toeplitz_factor_t *f, fptype *x)
+{
+	int i, d, n = f->n;
+	fptype *li, *lim = f->l + (size_t) (f->rows - 1) * (BANDWIDTH+1);
+
+	TRACE_SCOPE("toeplitz_solve");
+
+	for (i = 0; i < n; i++)
+	{
+		li = (i < f->rows) ? f->l + (size_t) i * (BANDWIDTH+1) : lim;
+		for (d = (i < BANDWIDTH) ? i : BANDWIDTH; d > 0; d--)
+			x[i] -= li[d] * x[i-d];
+		x[i] /= li[0];
+	}
+	for (i = n - 1; i >= 0; i--)
+	{
+		for (d = (i+BANDWIDTH < n) ? BANDWIDTH : n-1-i; d > 0; d--)
+		{
+			li = (i+d < f->rows) ? f->l + (size_t) (i+d) * (BANDWIDTH+1) : lim;
+			x[i] -= li[d] * x[i+d];
+		}
+		li = (i < f->rows) ? f->l + (size_t) i * (BANDWIDTH+1) : lim;
+		x[i] /= li[0];
+	}
+}
+
+
+/*
+ * Solves A * x = b sequentially and with the partitioned solver on 1, 2,
+ * 4, ... and finally opts->threads threads, printing the time of every
+ * run and how far its x is from the sequential one.
+ */
+static void solve_system_spike(fptype **a, fptype *b, int n, sys_id sid, solve_opts_t *opts,
+		arena_t *ws)
+{
+	int i, p, nblocks;
+	size_t mark;
+	fptype *x, *x_seq, **l, diff, err;
+	cholesky_factor_t f;
+	double t0, t1, t_seq;
+#ifdef PRINT_RESULTS
+	char filename[BUFF_SIZE];
+#endif
+
+	arena_reset(ws);
+	if (!(x = arena_alloc_1d(ws, n)) || !(x_seq = arena_alloc_1d(ws, n)))
+		return;
+	mark = ws->used;
+
+	t0 = wall_time();
+	if (cholesky_factorize(&f, a, n, opts, ws) != 0)
+		return;
+	memcpy(x_seq, b, n * sizeof(fptype));
+	cholesky_solve(&f, x_seq, 1, 1);
+	t_seq = wall_time() - t0;
+	cholesky_release(&f);
+	printf("\nSystem %d: sequential %.6f s\n", sid, t_seq);
+
+	/* The factor of the interior blocks replaces the sequential one */
+	ws->used = mark;
+	if (!(l = arena_alloc_2d(ws, n)))
+		return;
+	for (p = 1; ; p = (2*p < opts->threads) ? 2*p : opts->threads)
+	{
+		t0 = wall_time();
+		if ((nblocks = spike_solve(a, l, b, x, n, p)) < 0)
+			return;
+		t1 = wall_time();
+
+		err = 0;
+		for (i = 0; i < n; i++)
+		{
+			diff = FP_ABS(x[i] - x_seq[i]);
+			if (diff > err || isnan(diff))
+				err = diff;
+		}
+		printf("System %d: %3d threads (%3d blocks) %.6f s, speedup %.2f, "
+				"max |x - x_seq| = %g\n", sid, p, nblocks, t1 - t0,
+				t_seq / (t1 - t0), (double) err);
+		if (p == opts->threads)
+			break;
+	}
+
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+	printf("\nWriting X%d...\n", sid);
+	#endif
+	snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
+	write_1d_matrix(filename, x, n, opts->out);
+#endif
+}
+
+
+/*
+ * Solves the band system A * x = b with nblocks threads (fewer if n is too
+ * small for every block to have 2 * BANDWIDTH interior rows), using l for
+ * the factors of the interior blocks. Returns the number of blocks used,
+ * or -1 on failure.
+ */
+static int spike_solve(fptype **a, fptype **l, fptype *b, fptype *x, int n,
+		int nblocks)
+{
+	int k, r, c, m, rem, lo, q;
+	spike_block_t *blk;
+	pthread_t *tids;
+	fptype *s = NULL, *rhs = NULL;
+
+	if (nblocks > (n + BANDWIDTH) / (3 * BANDWIDTH))
+		nblocks = (n + BANDWIDTH) / (3 * BANDWIDTH);
+	if (nblocks < 1)
+		nblocks = 1;
+	q = (nblocks - 1) * BANDWIDTH;
+
+	blk = (spike_block_t *) calloc(nblocks, sizeof(spike_block_t));
+	tids = (pthread_t *) malloc(nblocks * sizeof(pthread_t));
+	if (q > 0)
+	{
+		s = (fptype *) calloc((size_t) q * q, sizeof(fptype));
+		rhs = (fptype *) malloc(q * sizeof(fptype));
+	}
+	if (!blk || !tids || (q > 0 && (!s || !rhs)))
+	{
+		perror("malloc");
+		nblocks = -1;
+		goto out;
+	}
+
+	/* Interior rows are shared out evenly; separators follow every block but the last */
+	m = (n - q) / nblocks;
+	rem = (n - q) % nblocks;
+	for (k = 0, lo = 0; k < nblocks; k++)
+	{
+		blk[k].a = a;
+		blk[k].l = l;
+		blk[k].b = b;
+		blk[k].x = x;
+		blk[k].lo = lo;
+		blk[k].hi = lo + m + (k < rem);
+		blk[k].left = (k > 0);
+		blk[k].right = (k < nblocks - 1);
+		lo = blk[k].hi + BANDWIDTH;
+	}
+
+	spike_run(blk, nblocks, spike_reduce, tids);
+
+	/*
+	 * Schur complement of the separators: separator k lies between blocks
+	 * k and k+1 and is only coupled to separators k-1 and k+1.
+	 */
+	for (k = 0; k < nblocks - 1; k++)
+	{
+		lo = blk[k].hi;
+		for (r = 0; r < BANDWIDTH; r++)
+		{
+			for (c = 0; c <= r; c++)
+				s[(size_t) (k*BANDWIDTH + r) * q + k*BANDWIDTH + c] =
+						a[r-c][lo+r] - blk[k].vv[r][c] -
+						blk[k+1].uu[r][c];
+			if (k < nblocks - 2)
+				for (c = 0; c < BANDWIDTH; c++)
+					s[(size_t) ((k+1)*BANDWIDTH + r) * q + k*BANDWIDTH + c] =
+							-blk[k+1].vu[r][c];
+			rhs[k*BANDWIDTH + r] = b[lo+r] - blk[k].vg[r] - blk[k+1].ug[r];
+		}
+	}
+	if (q > 0)
+		spike_schur_solve(s, rhs, q);
+	for (k = 0; k < nblocks - 1; k++)
+		for (r = 0; r < BANDWIDTH; r++)
+			x[blk[k].hi + r] = rhs[k*BANDWIDTH + r];
+
+	spike_run(blk, nblocks, spike_expand, tids);
+out:
+	free(blk);
+	free(tids);
+	free(s);
+	free(rhs);
+	return nblocks;
+}
+
+
+/* Runs fn on every block, one thread each; blocks without a thread run here */
+static void spike_run(spike_block_t *blk, int nblocks, void *(*fn)(void *),
+		pthread_t *tids)
+{
+	int k, started;
+
+	for (started = 0; started < nblocks; started++)
+		if (pthread_create(&tids[started], NULL, fn, &blk[started]) != 0)
+		{
+			perror("pthread_create");
+			break;
+		}
+	for (k = started; k < nblocks; k++)
+		fn(&blk[k]);
+	while (--started >= 0)
+		pthread_join(tids[started], NULL);
+}
+
+
+/*
+ * Factors the interior of a block and computes its Schur complement
+ * contributions. L_I^-1 b and L_I^-1 U are swept forward together, keeping
+ * only their last BANDWIDTH rows; V is non-zero in the last BANDWIDTH
+ * rows only, and so is L_I^-1 V. L_I^-1 U decays along the block: it is
+ * flushed to zero before it turns subnormal (which is slow to compute
+ * with) and no longer swept once BANDWIDTH+1 consecutive rows are zero.
+ */
+static void *spike_reduce(void *arg)
+{
+	spike_block_t *blk = (spike_block_t *) arg;
+	int i, d, c, c2, m = blk->hi - blk->lo, cols = blk->left ? BANDWIDTH+1 : 1,
+	    zero_rows = 0;
+	fptype *a[BANDWIDTH+1], *l[BANDWIDTH+1], t,
+	       y[BANDWIDTH+1][BANDWIDTH+1],     /* Rows i-BANDWIDTH..i of [g U'] */
+	       pv[BANDWIDTH][BANDWIDTH];
+
+	TRACE_SCOPE("spike_reduce");
+
+	for (d = 0; d <= BANDWIDTH; d++)
+	{
+		a[d] = blk->a[d] + blk->lo;
+		l[d] = blk->l[d] + blk->lo;
+	}
+	band_factor(a, l, m);
+
+	/* Column 0 of y is L_I^-1 b, columns 1..BANDWIDTH are L_I^-1 U */
+	for (i = 0; i < m; i++)
+	{
+		for (c = 0; c < cols; c++)
+		{
+			t = (c == 0) ? blk->b[blk->lo + i] : spike_u(blk, i, c-1);
+			for (d = 1; d <= BANDWIDTH && d <= i; d++)
+				t -= l[d][i] * y[(i-d) % (BANDWIDTH+1)][c];
+			t /= l[0][i];
+			y[i % (BANDWIDTH+1)][c] = (c > 0 && FP_ABS(t) < FP_MIN) ? 0.0 : t;
+		}
+		for (c = 1; c < cols; c++)
+		{
+			for (c2 = 1; c2 < cols; c2++)
+				blk->uu[c-1][c2-1] += y[i % (BANDWIDTH+1)][c] *
+						y[i % (BANDWIDTH+1)][c2];
+			blk->ug[c-1] += y[i % (BANDWIDTH+1)][c] * y[i % (BANDWIDTH+1)][0];
+		}
+		if (cols > 1)
+		{
+			for (c = 1; c < cols && y[i % (BANDWIDTH+1)][c] == 0.0; c++)
+				;
+			zero_rows = (c == cols) ? zero_rows + 1 : 0;
+			/* The ring now holds zeros only, and so would every later row */
+			if (zero_rows == BANDWIDTH+1)
+				cols = 1;
+		}
+	}
+	if (!blk->right)
+		return NULL;
+
+	/* Row m-BANDWIDTH+r of L_I^-1 V is pv[r] */
+	for (c = 0; c < BANDWIDTH; c++)
+	{
+		for (d = 0; d < BANDWIDTH; d++)
+		{
+			i = m - BANDWIDTH + d;
+			t = spike_v(blk, i, c);
+			for (c2 = 1; c2 <= d; c2++)
+				t -= l[c2][i] * pv[d-c2][c];
+			pv[d][c] = t / l[0][i];
+		}
+	}
+	for (c = 0; c < BANDWIDTH; c++)
+	{
+		for (d = 0; d < BANDWIDTH; d++)
+		{
+			i = (m - BANDWIDTH + d) % (BANDWIDTH+1);
+			for (c2 = 0; c2 < BANDWIDTH; c2++)
+			{
+				blk->vv[c][c2] += pv[d][c] * pv[d][c2];
+				if (blk->left)
+					blk->vu[c][c2] += pv[d][c] * y[i][c2+1];
+			}
+			blk->vg[c] += pv[d][c] * y[i][0];
+		}
+	}
+	return NULL;
+}
+
+
+/* x_I = A_I^-1 (b_I - U * x_S(before) - V * x_S(after)), once the separators are known */
+static void *spike_expand(void *arg)
+{
+	spike_block_t *blk = (spike_block_t *) arg;
+	int i, d, c, m = blk->hi - blk->lo;
+	fptype *l[BANDWIDTH+1], *x = blk->x + blk->lo;
+
+	TRACE_SCOPE("spike_expand");
+
+	for (d = 0; d <= BANDWIDTH; d++)
+		l[d] = blk->l[d] + blk->lo;
+	memcpy(x, blk->b + blk->lo, m * sizeof(fptype));
+	for (c = 0; c < BANDWIDTH; c++)
+	{
+		for (i = 0; i < BANDWIDTH; i++)
+		{
+			if (blk->left)
+				x[i] -= spike_u(blk, i, c) * blk->x[blk->lo - BANDWIDTH + c];
+			if (blk->right)
+				x[m-BANDWIDTH+i] -= spike_v(blk, m-BANDWIDTH+i, c) *
+						blk->x[blk->hi + c];
+		}
+	}
+	forward_substitution(l, x, m, 1, 1);
+	back_substitution(l, x, m, 1, 1);
+	return NULL;
+}
+
+
+/* U(i,c) = A(lo+i, lo-BANDWIDTH+c): coupling of the block to the separator before it */
+static fptype spike_u(spike_block_t *blk, int i, int c)
+{
+	return (i <= c) ? blk->a[i+BANDWIDTH-c][blk->lo + i] : 0.0;
+}
+
+
+/* V(i,c) = A(lo+i, hi+c): coupling of the block to the separator after it */
+static fptype spike_v(spike_block_t *blk, int i, int c)
+{
+	int d = blk->hi + c - (blk->lo + i);
+
+	return (d <= BANDWIDTH) ? blk->a[d][blk->hi + c] : 0.0;
+}
+
+
+/*
+ * Solves the (small) Schur complement system S * x = r in place by a
+ * dense Cholesky factorization; only the lower triangle of the q x q
+ * matrix s is used.
+ */
+static void spike_schur_solve(fptype *s, fptype *r, int q)
+{
+	int i, j, k;
+	fptype sum;
+
+	for (i = 0; i < q; i++)
+	{
+		for (j = 0; j <= i; j++)
+		{
+			sum = s[(size_t) i*q + j];
+			for (k = 0; k < j; k++)
+				sum -= s[(size_t) i*q + k] * s[(size_t) j*q + k];
+			s[(size_t) i*q + j] = (i == j) ? FP_SQRT(sum) : sum / s[(size_t) j*q + j];
+		}
+	}
+	for (i = 0; i < q; i++)
+	{
+		for (k = 0; k < i; k++)
+			r[i] -= s[(size_t) i*q + k] * r[k];
+		r[i] /= s[(size_t) i*q + i];
+	}
+	for (i = q-1; i >= 0; i--)
+	{
+		for (k = i+1; k < q; k++)
+			r[i] -= s[(size_t) k*q + i] * r[k];
+		r[i] /= s[(size_t) i*q + i];
+	}
+}
+#endif
+
+/*
+ * Solves A * x = b for the sparse SPD matrix A of opts->input, with b the
+ * row sums of A so that x is all ones.
+ */
+static int solve_system_sparse(solve_opts_t *opts)
+{
+	int i, n, ret = EXIT_FAILURE;
+	int64_t p;
+	csr_matrix_t *a, a2;
+	sparse_handle_t *h = NULL;
+	skyline_t sk;
+	fptype *x = NULL, *ones = NULL, *x2 = NULL, *val2 = NULL, err;
+	double t0, t1, t2, t3;
+#ifdef PRINT_RESULTS
+	char filename[BUFF_SIZE];
+#endif
+
+	TRACE_SCOPE("solve_system_sparse");
+
+	t0 = wall_time();
+	if (!(a = PREC_NAME(csr_load)(opts->input, opts->threads)))
+		return EXIT_FAILURE;
+	n = a->n;
+	printf("N = %d, nnz(A) = %lld, loaded in %.6f s\n", n,
+			(long long) a->nnz, wall_time() - t0);
+
+	memset(&sk, 0, sizeof(sk));
+	if (!(x = alloc_1d_matrix(n)) || !(ones = alloc_1d_matrix(n)))
+		goto out;
+	for (i = 0; i < n; i++)
+		ones[i] = 1;
+	PREC_NAME(csr_matvec)(a, ones, x);
+
+	if (opts->alg == ALG_SKYLINE)
+	{
+		if (skyline_from_csr(&sk, a) != 0 || skyline_run(&sk, x, S1) != 0)
+			goto out;
+		goto done;
+	}
+
+	t0 = wall_time();
+	if (!(h = PREC_NAME(cholesky_sparse_analyze)(a, opts->order)))
+		goto out;
+	t1 = wall_time();
+	if (PREC_NAME(cholesky_sparse_factorize)(h, a) != 0)
+	{
+		fprintf(stderr, "%s: matrix is not positive definite\n", opts->input);
+		goto out;
+	}
+	t2 = wall_time();
+	PREC_NAME(cholesky_sparse_solve)(h, x);
+	t3 = wall_time();
+
+	printf("\nnnz(L) = %lld in %d supernodes (%s ordering): symbolic %.6f s, "
+			"numeric %.6f s, solve %.6f s\n", (long long) h->sym.nnz, h->sym.nsuper,
+			(opts->order == ORDER_ND) ? "nested dissection" : "natural",
+			t1 - t0, t2 - t1, t3 - t2);
+
+	/*
+	 * The analysis holds for every matrix with the pattern of A: 2A is
+	 * factored with it, without a symbolic phase, and 2A * x = 2b solved
+	 */
+	if (!(x2 = alloc_1d_matrix(n)) || !(val2 = (fptype *) alloc_aligned((a->nnz + 1) * sizeof(fptype))))
+		goto out;
+	a2 = *a;
+	a2.val = val2;
+	for (p = 0; p < a->nnz; p++)
+		val2[p] = 2 * a->val[p];
+	PREC_NAME(csr_matvec)(&a2, ones, x2);
+	t0 = wall_time();
+	if (PREC_NAME(cholesky_sparse_factorize)(h, &a2) != 0)
+		goto out;
+	t1 = wall_time();
+	PREC_NAME(cholesky_sparse_solve)(h, x2);
+	t2 = wall_time();
+	for (i = 0, err = 0; i < n; i++)
+		if (FP_ABS(x2[i] - x[i]) > err)
+			err = FP_ABS(x2[i] - x[i]);
+	printf("Refactored as 2A: numeric %.6f s, solve %.6f s, max |x(2A) - x(A)| = %.3Le\n",
+			t1 - t0, t2 - t1, (long double) err);
+
+done:
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+	printf("\nWriting X...\n");
+	#endif
+	snprintf(filename, BUFF_SIZE, "x_%d.txt", n);
+	write_1d_matrix(filename, x, n, opts->out);
+#endif
+	ret = EXIT_SUCCESS;
+out:
+	PREC_NAME(cholesky_sparse_destroy)(h);
+	skyline_free(&sk);
+	free(x);
+	free(ones);
+	free(x2);
+	free(val2);
+	PREC_NAME(csr_free)(a);
+	return ret;
+}
+
+
+/*
+ * Solves A * x = b with the skyline factorization; the profile of A is
+ * detected from the matrix in the build's storage.
+ */
+static void solve_system_skyline(fptype **a, fptype *b, int n, sys_id sid,
+		solve_opts_t *opts)
+{
+	skyline_t sk;
+	fptype *x;
+#ifdef PRINT_RESULTS
+	char filename[BUFF_SIZE];
+#endif
+
+	TRACE_SCOPE("solve_system_skyline");
+
+	if (skyline_from_matrix(&sk, a, n) != 0)
+		return;
+	if (!(x = alloc_1d_matrix(n)))
+	{
+		skyline_free(&sk);
+		return;
+	}
+	memcpy(x, b, n * sizeof(fptype));
+	if (skyline_run(&sk, x, sid) == 0)
+	{
+#ifdef PRINT_RESULTS
+	#ifndef PRINT_TOFILE
+		printf("\nWriting X%d...\n", sid);
+	#endif
+		snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
+		write_1d_matrix(filename, x, n, opts->out);
+#endif
+	}
+	free(x);
+	skyline_free(&sk);
+}
+
+
+/* Factors sk in place and overwrites x with A^-1 * x */
+static int skyline_run(skyline_t *sk, fptype *x, sys_id sid)
+{
+	double t0, t1, t2;
+
+	t0 = wall_time();
+	if (skyline_factor(sk) != 0)
+	{
+		fprintf(stderr, "System %d: matrix is not positive definite\n", sid);
+		return EXIT_FAILURE;
+	}
+	t1 = wall_time();
+	skyline_solve(sk, x);
+	t2 = wall_time();
+
+	printf("\nSystem %d: profile of %lld elements (%.2f%% of the lower triangle), "
+			"factorization %.6f s, solve %.6f s\n", sid,
+			(long long) sk->ptr[sk->n], 100.0 * sk->ptr[sk->n] /
+			((double) sk->n * (sk->n + 1) / 2), t1 - t0, t2 - t1);
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Profile of A from the matrix in the build's storage: the first nonzero
+ * of every row is searched for from the left end of the row (or of the
+ * band), and the profile is then copied out.
+ */
+static int skyline_from_matrix(skyline_t *sk, fptype **a, int n)
+{
+	int i, j;
+
+	sk->n = n;
+	sk->ptr = NULL;
+	sk->val = NULL;
+	if (!(sk->first = (int *) malloc(n * sizeof(int))))
+	{
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < n; i++)
+	{
+#ifdef OPTIMIZED
+		j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0;
+#else
+		j = 0;
+#endif
+		while (j < i && LOWER(a, i, j) == 0)
+			j++;
+		sk->first[i] = j;
+	}
+	if (skyline_alloc(sk) != 0)
+	{
+		skyline_free(sk);
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < n; i++)
+		for (j = sk->first[i]; j <= i; j++)
+			sk->val[sk->ptr[i] + j - sk->first[i]] = LOWER(a, i, j);
+	return EXIT_SUCCESS;
+}
+
+
+/* Profile of a CSR matrix, whose rows have their columns sorted */
+static int skyline_from_csr(skyline_t *sk, csr_matrix_t *a)
+{
+	int i, n = a->n;
+	int64_t p;
+
+	sk->n = n;
+	sk->ptr = NULL;
+	sk->val = NULL;
+	if (!(sk->first = (int *) malloc(n * sizeof(int))))
+	{
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < n; i++)
+	{
+		p = a->row_ptr[i];
+		sk->first[i] = (p < a->row_ptr[i+1] && a->col[p] < i) ? a->col[p] : i;
+	}
+	if (skyline_alloc(sk) != 0)
+	{
+		skyline_free(sk);
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < n; i++)
+		for (p = a->row_ptr[i]; p < a->row_ptr[i+1] && a->col[p] <= i; p++)
+			sk->val[sk->ptr[i] + a->col[p] - sk->first[i]] = a->val[p];
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Row offsets and zeroed values of the profile given by sk->first; on
+ * failure, the caller frees sk with skyline_free().
+ */
+static int skyline_alloc(skyline_t *sk)
+{
+	int i;
+
+	if (!(sk->ptr = (int64_t *) malloc((sk->n + 1) * sizeof(int64_t))))
+	{
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	sk->ptr[0] = 0;
+	for (i = 0; i < sk->n; i++)
+		sk->ptr[i+1] = sk->ptr[i] + i - sk->first[i] + 1;
+	if (!(sk->val = (fptype *) alloc_aligned(sk->ptr[sk->n] * sizeof(fptype))))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Row-oriented Cholesky factorization over the profile: with li and lj
+ * rows i and j of L indexed by column, L(i,j) is A(i,j) minus the dot
+ * product of li and lj over the columns both rows have, divided by
+ * L(j,j). The dot products run over contiguous memory, and the work is
+ * proportional to the sum of the squared row lengths.
+ */
+static int skyline_factor(skyline_t *sk)
+{
+	int i, j, k, k0, fi;
+	fptype *li, *lj, sum;
+
+	TRACE_SCOPE("skyline_factor");
+
+	for (i = 0; i < sk->n; i++)
+	{
+		fi = sk->first[i];
+		li = sk->val + sk->ptr[i] - fi;
+		for (j = fi; j < i; j++)
+		{
+			lj = sk->val + sk->ptr[j] - sk->first[j];
+			k0 = (fi > sk->first[j]) ? fi : sk->first[j];
+			for (k = k0, sum = 0; k < j; k++)
+				sum += li[k] * lj[k];
+			li[j] = (li[j] - sum) / lj[j];
+		}
+		for (k = fi, sum = 0; k < i; k++)
+			sum += li[k] * li[k];
+		if (!(li[i] - sum > 0))
+			return EXIT_FAILURE;
+		li[i] = FP_SQRT(li[i] - sum);
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * L * y = b by rows (dot products) and L^T * x = y by the columns of L^T,
+ * i.e. the rows of L (axpys), in place.
+ */
+static void skyline_solve(skyline_t *sk, fptype *x)
+{
+	int i, k;
+	fptype *li, sum;
+
+	TRACE_SCOPE("skyline_solve");
+
+	for (i = 0; i < sk->n; i++)
+	{
+		li = sk->val + sk->ptr[i] - sk->first[i];
+		for (k = sk->first[i], sum = x[i]; k < i; k++)
+			sum -= li[k] * x[k];
+		x[i] = sum / li[i];
+	}
+	for (i = sk->n - 1; i >= 0; i--)
+	{
+		li = sk->val + sk->ptr[i] - sk->first[i];
+		x[i] /= li[i];
+		for (k = sk->first[i]; k < i; k++)
+			x[k] -= li[k] * x[i];
+	}
+}
+
+
+static void skyline_free(skyline_t *sk)
+{
+	free(sk->first);
+	free(sk->ptr);
+	free(sk->val);
+	sk->first = NULL;
+	sk->ptr = NULL;
+	sk->val = NULL;
+}
+
+
+/*
+ * Symbolic analysis of A: the ordering, the elimination tree of P A P^T in
+ * postorder (so that the columns of every supernode are consecutive), the
+ * column counts of L and its supernodes.
+ */
+static int sparse_symbolic(sparse_symbolic_t *sym, csr_matrix_t *a,
+		sparse_order order)
+{
+	int i, j, k, r, top, n = a->n, *work;
+	int64_t p;
+
+	TRACE_SCOPE("sparse_symbolic");
+
+	sym->n = n;
+	sym->perm      = (int *) malloc(n * sizeof(int));
+	sym->pinv      = (int *) malloc(n * sizeof(int));
+	sym->parent    = (int *) malloc(n * sizeof(int));
+	sym->count     = (int *) calloc(n, sizeof(int));
+	sym->col_super = (int *) malloc(n * sizeof(int));
+	work           = (int *) malloc(3 * (size_t) n * sizeof(int));
+	if (!sym->perm || !sym->pinv || !sym->parent || !sym->count ||
+			!sym->col_super || !work)
+	{
+		perror("malloc");
+		free(work);
+		return EXIT_FAILURE;
+	}
+
+	for (k = 0; k < n; k++)
+		sym->perm[k] = k;
+	if (order == ORDER_ND && sparse_order_nd(sym->perm, a) != 0)
+	{
+		free(work);
+		return EXIT_FAILURE;
+	}
+	for (k = 0; k < n; k++)
+		sym->pinv[sym->perm[k]] = k;
+
+	/* Row k links every j < k it touches to k, with path compression */
+	for (k = 0; k < n; k++)
+	{
+		sym->parent[k] = -1;
+		work[k] = -1;
+		r = sym->perm[k];
+		for (p = a->row_ptr[r]; p < a->row_ptr[r+1]; p++)
+			for (i = sym->pinv[a->col[p]]; i != -1 && i < k; i = j)
+			{
+				j = work[i];
+				work[i] = k;
+				if (j == -1)
+					sym->parent[i] = k;
+			}
+	}
+	sparse_postorder(sym, work);
+
+	/* Row k of L has an entry in every column sparse_ereach() visits */
+	for (k = 0; k < n; k++)
+		work[k] = -1;
+	for (k = 0; k < n; k++)
+	{
+		for (top = sparse_ereach(sym, a, k, work + n, work); top < n; top++)
+			sym->count[work[n + top]]++;
+		sym->count[k]++;
+	}
+	for (k = 0, sym->nnz = 0; k < n; k++)
+		sym->nnz += sym->count[k];
+
+	r = sparse_supernodes(sym, a, work + n, work);
+	free(work);
+	return r;
+}
+
+
+/*
+ * Relabels the elimination tree in postorder, children in ascending order,
+ * and the ordering with it. work holds 3 * n ints.
+ */
+static void sparse_postorder(sparse_symbolic_t *sym, int *work)
+{
+	int i, j, k, top, n = sym->n, *head = work, *next = work + n, *stack = work + 2*n;
+	int *post = sym->pinv;
+
+	for (j = 0; j < n; j++)
+		head[j] = -1;
+	for (j = n - 1; j >= 0; j--)
+		if (sym->parent[j] != -1)
+		{
+			next[j] = head[sym->parent[j]];
+			head[sym->parent[j]] = j;
+		}
+	for (j = 0, k = 0; j < n; j++)
+	{
+		if (sym->parent[j] != -1)
+			continue;
+		stack[0] = j;
+		for (top = 0; top >= 0; )
+		{
+			i = head[stack[top]];
+			if (i == -1)
+				post[k++] = stack[top--];
+			else
+			{
+				head[stack[top]] = next[i];
+				stack[++top] = i;
+			}
+		}
+	}
+
+	/* Column k of the new order is post[k] of the old one */
+	for (k = 0; k < n; k++)
+		head[post[k]] = k;
+	for (k = 0; k < n; k++)
+	{
+		next[k] = sym->perm[post[k]];
+		stack[k] = (sym->parent[post[k]] == -1) ? -1 : head[sym->parent[post[k]]];
+	}
+	memcpy(sym->perm, next, n * sizeof(int));
+	memcpy(sym->parent, stack, n * sizeof(int));
+	for (k = 0; k < n; k++)
+		sym->pinv[sym->perm[k]] = k;
+}
+
+
+/*
+ * Fundamental supernodes: column j+1 joins the supernode of column j if j
+ * is its only child and the pattern of column j is that of j+1 plus j.
+ * The rows of every supernode are those of its first column, gathered
+ * row by row of L, so they end up sorted.
+ */
+static int sparse_supernodes(sparse_symbolic_t *sym, csr_matrix_t *a,
+		int *stack, int *mark)
+{
+	int j, k, s, top, n = sym->n, *children = stack;
+	int64_t *fill;
+
+	for (j = 0; j < n; j++)
+		children[j] = 0;
+	for (j = 0; j < n; j++)
+		if (sym->parent[j] != -1)
+			children[sym->parent[j]]++;
+	for (j = 0, s = -1; j < n; j++)
+	{
+		if (j == 0 || sym->parent[j-1] != j || children[j] != 1 ||
+				sym->count[j-1] != sym->count[j] + 1)
+			s++;
+		sym->col_super[j] = s;
+	}
+	sym->nsuper = s + 1;
+
+	sym->super = (int *) malloc((sym->nsuper + 1) * sizeof(int));
+	sym->rp    = (int64_t *) malloc((sym->nsuper + 1) * sizeof(int64_t));
+	sym->xp    = (int64_t *) malloc((sym->nsuper + 1) * sizeof(int64_t));
+	fill       = (int64_t *) malloc(sym->nsuper * sizeof(int64_t));
+	if (!sym->super || !sym->rp || !sym->xp || !fill)
+	{
+		perror("malloc");
+		free(fill);
+		return EXIT_FAILURE;
+	}
+	for (j = n - 1; j >= 0; j--)
+		sym->super[sym->col_super[j]] = j;
+	sym->super[sym->nsuper] = n;
+	sym->rp[0] = sym->xp[0] = 0;
+	sym->max_rows = 0;
+	for (s = 0; s < sym->nsuper; s++)
+	{
+		k = sym->count[sym->super[s]];
+		fill[s] = sym->rp[s];
+		sym->rp[s+1] = sym->rp[s] + k;
+		sym->xp[s+1] = sym->xp[s] + (int64_t) k * (sym->super[s+1] - sym->super[s]);
+		if (k > sym->max_rows)
+			sym->max_rows = k;
+	}
+	if (!(sym->ri = (int32_t *) malloc((sym->rp[sym->nsuper] + 1) * sizeof(int32_t))))
+	{
+		perror("malloc");
+		free(fill);
+		return EXIT_FAILURE;
+	}
+
+	for (k = 0; k < n; k++)
+		mark[k] = -1;
+	for (k = 0; k < n; k++)
+	{
+		for (top = sparse_ereach(sym, a, k, stack, mark); top < n; top++)
+		{
+			s = sym->col_super[stack[top]];
+			if (fill[s] == sym->rp[s] || sym->ri[fill[s]-1] != k)
+				sym->ri[fill[s]++] = k;
+		}
+		s = sym->col_super[k];
+		if (fill[s] == sym->rp[s] || sym->ri[fill[s]-1] != k)
+			sym->ri[fill[s]++] = k;
+	}
+	free(fill);
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Nested dissection on the graph of A: every connected subgraph is split
+ * by a separator, a level of a breadth-first search from a pseudo-
+ * peripheral vertex, and the two halves are ordered before it.
+ */
+static int sparse_order_nd(int *perm, csr_matrix_t *a)
+{
+	int n = a->n, ret = EXIT_FAILURE;
+	nd_work_t w;
+
+	w.a = a;
+	w.stamp = 0;
+	w.parts = 0;
+	w.part       = (int *) calloc(n, sizeof(int));
+	w.seen       = (int *) calloc(n, sizeof(int));
+	w.level      = (int *) malloc(n * sizeof(int));
+	w.level_size = (int *) malloc((n + 1) * sizeof(int));
+	w.queue      = (int *) malloc(n * sizeof(int));
+	w.tmp        = (int *) malloc(n * sizeof(int));
+	if (w.part && w.seen && w.level && w.level_size && w.queue && w.tmp)
+	{
+		nd_order(&w, perm, n);
+		ret = EXIT_SUCCESS;
+	}
+	else
+		perror("malloc");
+	free(w.part);
+	free(w.seen);
+	free(w.level);
+	free(w.level_size);
+	free(w.queue);
+	free(w.tmp);
+	return ret;
+}
+
+
+/* Orders the vertices of seg, one connected component at a time */
+static void nd_order(nd_work_t *w, int *seg, int cnt)
+{
+	int i, k, c, depth;
+
+	while (cnt > 0)
+	{
+		c = nd_bfs(w, seg[0], w->part[seg[0]], &depth);
+		memcpy(w->tmp, w->queue, c * sizeof(int));
+		for (i = 0, k = c; i < cnt; i++)
+			if (w->seen[seg[i]] != w->stamp)
+				w->tmp[k++] = seg[i];
+		memcpy(seg, w->tmp, cnt * sizeof(int));
+		nd_dissect(w, seg, c);
+		seg += c;
+		cnt -= c;
+	}
+}
+
+
+/*
+ * Orders the connected subgraph seg as [A][B][S], where the separator S
+ * is the vertices of the middle level that have a neighbour in the next
+ * one; small subgraphs and cliques keep their breadth-first order.
+ */
+static void nd_dissect(nd_work_t *w, int *seg, int cnt)
+{
+	int i, m, v, root, depth, prev, label = w->part[seg[0]], la, lb, na, nb;
+	int64_t p;
+	csr_matrix_t *a = w->a;
+
+	if (cnt <= ND_LEAF)
+	{
+		for (i = 0; i < cnt; i++)
+			w->part[seg[i]] = -1;
+		return;
+	}
+
+	/* Restart from the farthest vertex while the BFS gets deeper */
+	for (i = 0, prev = -1, root = seg[0]; i < ND_ROOT_TRIES; i++)
+	{
+		nd_bfs(w, root, label, &depth);
+		if (depth <= prev)
+			break;
+		prev = depth;
+		root = w->queue[cnt-1];
+	}
+	if (depth < 2)
+	{
+		for (i = 0; i < cnt; i++)
+			w->part[seg[i]] = -1;
+		return;
+	}
+
+	for (i = 0; i <= depth; i++)
+		w->level_size[i] = 0;
+	for (i = 0; i < cnt; i++)
+		w->level_size[w->level[w->queue[i]]]++;
+	for (m = 0, na = w->level_size[0]; na < cnt / 2; )
+		na += w->level_size[++m];
+	if (m < 1)
+		m = 1;
+	if (m > depth - 1)
+		m = depth - 1;
+
+	/* Separator vertices get level -1; the rest of level m joins A */
+	for (i = 0; i < cnt; i++)
+	{
+		v = w->queue[i];
+		if (w->level[v] != m)
+			continue;
+		for (p = a->row_ptr[v]; p < a->row_ptr[v+1]; p++)
+			if (w->part[a->col[p]] == label && w->level[a->col[p]] == m + 1)
+			{
+				w->level[v] = -1;
+				break;
+			}
+	}
+
+	la = ++w->parts;
+	lb = ++w->parts;
+	for (i = 0, na = 0; i < cnt; i++)
+		if (w->level[seg[i]] >= 0 && w->level[seg[i]] <= m)
+			na++;
+	for (i = 0, nb = 0; i < cnt; i++)
+		if (w->level[seg[i]] > m)
+			nb++;
+	for (i = 0, prev = 0; i < cnt; i++)
+	{
+		v = seg[i];
+		if (w->level[v] < 0)
+		{
+			w->part[v] = -1;
+			w->tmp[na + nb + prev++] = v;
+		}
+	}
+	for (i = 0, prev = 0, depth = na; i < cnt; i++)
+	{
+		v = seg[i];
+		if (w->level[v] >= 0 && w->level[v] <= m)
+		{
+			w->part[v] = la;
+			w->tmp[prev++] = v;
+		}
+		else if (w->level[v] > m)
+		{
+			w->part[v] = lb;
+			w->tmp[depth++] = v;
+		}
+	}
+	memcpy(seg, w->tmp, cnt * sizeof(int));
+	nd_order(w, seg, na);
+	nd_order(w, seg + na, nb);
+}
+
+
+/*
+ * Breadth-first search from root over the vertices of subgraph label; the
+ * vertices reached are left in w->queue, their distances in w->level, and
+ * their number is returned.
+ */
+static int nd_bfs(nd_work_t *w, int root, int label, int *depth)
+{
+	int v, u, head, tail = 0;
+	int64_t p;
+	csr_matrix_t *a = w->a;
+
+	w->stamp++;
+	w->seen[root] = w->stamp;
+	w->level[root] = 0;
+	w->queue[tail++] = root;
+	for (head = 0; head < tail; head++)
+	{
+		v = w->queue[head];
+		for (p = a->row_ptr[v]; p < a->row_ptr[v+1]; p++)
+		{
+			u = a->col[p];
+			if (w->part[u] == label && w->seen[u] != w->stamp)
+			{
+				w->seen[u] = w->stamp;
+				w->level[u] = w->level[v] + 1;
+				w->queue[tail++] = u;
+			}
+		}
+	}
+	*depth = w->level[w->queue[tail-1]];
+	return tail;
+}
+
+
+/*
+ * Pattern of row k of L, excluding the diagonal: the nodes of the
+ * elimination tree on the paths from the columns of row k of P A P^T to k.
+ * They are left in stack[top..n-1] in topological order and top is
+ * returned.
+ */
+static int sparse_ereach(sparse_symbolic_t *sym, csr_matrix_t *a, int k,
+		int *stack, int *mark)
+{
+	int i, len, top = sym->n, r = sym->perm[k];
+	int64_t p;
+
+	mark[k] = k;
+	for (p = a->row_ptr[r]; p < a->row_ptr[r+1]; p++)
+	{
+		if ((i = sym->pinv[a->col[p]]) > k)
+			continue;
+		for (len = 0; mark[i] != k; i = sym->parent[i])
+		{
+			stack[len++] = i;
+			mark[i] = k;
+		}
+		while (len > 0)
+			stack[--top] = stack[--len];
+	}
+	return top;
+}
+
+
+/*
+ * Left-looking supernodal factorization: every supernode gathers its
+ * columns of P A P^T, subtracts the updates of the supernodes below it
+ * that reach its columns, and is factored as a dense panel. A supernode
+ * waits in the list of the next supernode it updates. The values are
+ * cleared first, so that f can be refactored for another matrix with the
+ * pattern of sym.
+ */
+static int sparse_numeric(sparse_factor_t *f, sparse_symbolic_t *sym,
+		csr_matrix_t *a)
+{
+	int i, j, k, s, d, dn, fs, nc, nr, *rows;
+	int64_t p;
+	fptype *l;
+
+	TRACE_SCOPE("sparse_numeric");
+
+	if (!f->lx)
+	{
+		f->lx   = (fptype *) alloc_aligned((sym->xp[sym->nsuper] + 1) * sizeof(fptype));
+		f->buf  = (fptype *) alloc_aligned(SN_COLS * (size_t) sym->max_rows * sizeof(fptype));
+		f->map  = (int *) malloc(sym->n * sizeof(int));
+		f->head = (int *) malloc(sym->nsuper * sizeof(int));
+		f->next = (int *) malloc(sym->nsuper * sizeof(int));
+		f->pos  = (int64_t *) malloc(sym->nsuper * sizeof(int64_t));
+		if (!f->lx || !f->buf || !f->map || !f->head || !f->next || !f->pos)
+		{
+			perror("malloc");
+			sparse_factor_free(f);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+		memset(f->lx, 0, sym->xp[sym->nsuper] * sizeof(fptype));
+	for (s = 0; s < sym->nsuper; s++)
+		f->head[s] = -1;
+
+	for (s = 0; s < sym->nsuper; s++)
+	{
+		fs = sym->super[s];
+		nc = sym->super[s+1] - fs;
+		nr = sym->rp[s+1] - sym->rp[s];
+		rows = sym->ri + sym->rp[s];
+		l = f->lx + sym->xp[s];
+		for (i = 0; i < nr; i++)
+			f->map[rows[i]] = i;
+
+		for (j = fs; j < fs + nc; j++)
+		{
+			k = sym->perm[j];
+			for (p = a->row_ptr[k]; p < a->row_ptr[k+1]; p++)
+				if ((i = sym->pinv[a->col[p]]) >= j)
+					l[f->map[i] + (int64_t) (j - fs) * nr] += a->val[p];
+		}
+		for (d = f->head[s]; d != -1; d = dn)
+		{
+			dn = f->next[d];
+			sparse_update(f, sym, d, s);
+		}
+		if (sparse_panel(l, nr, nc, f->buf) != 0)
+			return EXIT_FAILURE;
+
+		f->pos[s] = sym->rp[s] + nc;
+		if (nc < nr)
+		{
+			d = sym->col_super[rows[nc]];
+			f->next[s] = f->head[d];
+			f->head[d] = s;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Subtracts L_d(r, :) * L_d(c, :)^T from supernode s, for the rows c of
+ * supernode d that are columns of s and the rows r of d at or below them,
+ * SN_COLS columns at a time; d then moves to the list of the next
+ * supernode it updates.
+ */
+static void sparse_update(sparse_factor_t *f, sparse_symbolic_t *sym, int d, int s)
+{
+	int i, b, c, t, nb, jj, p0, p1, n1, n2, fs = sym->super[s], end = sym->super[s+1],
+	    nrs = sym->rp[s+1] - sym->rp[s], ncd = sym->super[d+1] - sym->super[d],
+	    nrd = sym->rp[d+1] - sym->rp[d], *rows = sym->ri + sym->rp[d];
+	fptype *ls = f->lx + sym->xp[s], *ld = f->lx + sym->xp[d], *col, *u;
+
+	p0 = f->pos[d] - sym->rp[d];
+	for (p1 = p0; p1 < nrd && rows[p1] < end; p1++)
+		;
+	n1 = p1 - p0;
+	n2 = nrd - p0;
+	for (jj = 0; jj < n1; jj += SN_COLS)
+	{
+		nb = (n1 - jj < SN_COLS) ? n1 - jj : SN_COLS;
+		sparse_block(f->buf, sym->max_rows, ld + p0 + jj, nrd, n2 - jj, nb, ncd);
+		for (b = 0; b < nb; b++)
+		{
+			c = rows[p0 + jj + b] - fs;
+			col = ls + (int64_t) c * nrs;
+			u = f->buf + b * sym->max_rows;
+			for (i = b; i < n2 - jj; i++)
+				col[f->map[rows[p0 + jj + i]]] -= u[i];
+		}
+	}
+
+	f->pos[d] += n1;
+	if (p1 < nrd)
+	{
+		t = sym->col_super[rows[p1]];
+		f->next[d] = f->head[t];
+		f->head[t] = d;
+	}
+}
+
+
+/*
+ * Cholesky factorization of the nr x nc column-major panel l of a
+ * supernode: its top nc x nc block becomes the diagonal block of L and
+ * the rows below are solved against it. Every SN_COLS columns take the
+ * update of all the columns before them through sparse_block(), and are
+ * then factored among themselves.
+ */
+static int sparse_panel(fptype *l, int nr, int nc, fptype *buf)
+{
+	int i, j, k, b, jb, nb;
+	fptype d, ljk, *lj, *lk;
+
+	for (jb = 0; jb < nc; jb += SN_COLS)
+	{
+		nb = (nc - jb < SN_COLS) ? nc - jb : SN_COLS;
+		if (jb > 0)
+		{
+			sparse_block(buf, nr, l + jb, nr, nr - jb, nb, jb);
+			for (b = 0; b < nb; b++)
+				for (i = b, lj = l + (int64_t) (jb + b) * nr + jb; i < nr - jb; i++)
+					lj[i] -= buf[b * nr + i];
+		}
+		for (j = jb; j < jb + nb; j++)
+		{
+			lj = l + (int64_t) j * nr;
+			for (k = jb; k < j; k++)
+			{
+				lk = l + (int64_t) k * nr;
+				ljk = lk[j];
+				for (i = j; i < nr; i++)
+					lj[i] -= lk[i] * ljk;
+			}
+			if (!(lj[j] > 0))
+				return EXIT_FAILURE;
+			d = lj[j] = FP_SQRT(lj[j]);
+			for (i = j + 1; i < nr; i++)
+				lj[i] /= d;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * buf(i, b) = sum over k of a(i, k) * a(b, k), for the m x kc column-major
+ * block a and the nb <= SN_COLS first rows of it. A vector of a column of
+ * a is loaded once for all nb columns of buf, whose vectors stay in
+ * registers for the whole reduction.
+ */
+static void sparse_block(fptype *buf, int ldbuf, const fptype *a, int lda,
+		int m, int nb, int kc)
+{
+	int i, b, k;
+	fpvec acc[SN_COLS], av;
+	fptype sum;
+
+	for (i = 0; i + VEC_LANES <= m; i += VEC_LANES)
+	{
+		memset(acc, 0, sizeof(acc));
+		for (k = 0; k < kc; k++)
+		{
+			memcpy(&av, a + i + (int64_t) k * lda, sizeof(fpvec));
+			for (b = 0; b < nb; b++)
+				acc[b] += av * a[b + (int64_t) k * lda];
+		}
+		for (b = 0; b < nb; b++)
+			memcpy(buf + b * ldbuf + i, &acc[b], sizeof(fpvec));
+	}
+	for (; i < m; i++)
+		for (b = 0; b < nb; b++)
+		{
+			for (k = 0, sum = 0; k < kc; k++)
+				sum += a[i + (int64_t) k * lda] * a[b + (int64_t) k * lda];
+			buf[b * ldbuf + i] = sum;
+		}
+}
+
+
+/*
+ * A * x = b, in place, as L * z = P b and L^T * y = z by supernodes, and
+ * x = P^T y; y is a work vector of n elements.
+ */
+static void sparse_solve(sparse_symbolic_t *sym, sparse_factor_t *f,
+		fptype *x, fptype *y)
+{
+	int i, j, k, s, fs, nc, nr, *rows;
+	fptype *l, *lj, sum;
+
+	TRACE_SCOPE("sparse_solve");
+
+	for (k = 0; k < sym->n; k++)
+		y[k] = x[sym->perm[k]];
+	for (s = 0; s < sym->nsuper; s++)
+	{
+		fs = sym->super[s];
+		nc = sym->super[s+1] - fs;
+		nr = sym->rp[s+1] - sym->rp[s];
+		rows = sym->ri + sym->rp[s];
+		l = f->lx + sym->xp[s];
+		for (j = 0; j < nc; j++)
+		{
+			lj = l + (int64_t) j * nr;
+			sum = y[fs+j] /= lj[j];
+			for (i = j + 1; i < nr; i++)
+				y[rows[i]] -= lj[i] * sum;
+		}
+	}
+	for (s = sym->nsuper - 1; s >= 0; s--)
+	{
+		fs = sym->super[s];
+		nc = sym->super[s+1] - fs;
+		nr = sym->rp[s+1] - sym->rp[s];
+		rows = sym->ri + sym->rp[s];
+		l = f->lx + sym->xp[s];
+		for (j = nc - 1; j >= 0; j--)
+		{
+			lj = l + (int64_t) j * nr;
+			for (i = j + 1, sum = y[fs+j]; i < nr; i++)
+				sum -= lj[i] * y[rows[i]];
+			y[fs+j] = sum / lj[j];
+		}
+	}
+	for (k = 0; k < sym->n; k++)
+		x[sym->perm[k]] = y[k];
+}
+
+
+static void sparse_symbolic_free(sparse_symbolic_t *sym)
+{
+	free(sym->perm);
+	free(sym->pinv);
+	free(sym->parent);
+	free(sym->count);
+	free(sym->col_super);
+	free(sym->super);
+	free(sym->rp);
+	free(sym->ri);
+	free(sym->xp);
+}
+
+
+static void sparse_factor_free(sparse_factor_t *f)
+{
+	free(f->lx);
+	free(f->map);
+	free(f->head);
+	free(f->next);
+	free(f->pos);
+	free(f->buf);
+	memset(f, 0, sizeof(sparse_factor_t));
+}
+
+
+/* Matrix in the storage of the build (band or dense), zeroed */
+fptype **PREC_NAME(cholesky_matrix_alloc)(int n)
+{
+	return alloc_2d_matrix(n);
+}
+
+
+void PREC_NAME(cholesky_matrix_free)(fptype **a, int n)
+{
+	free_2d_matrix(a, n);
+}
+
+
+/*
+ * Factors A into a new handle that owns the workspace of L; returns NULL
+ * on failure. A is not modified.
+ */
+cholesky_handle_t *PREC_NAME(cholesky_factor_create)(fptype **a, int n, solve_opts_t *opts)
+{
+	cholesky_handle_t *h;
+
+	if (!(h = (cholesky_handle_t *) malloc(sizeof(cholesky_handle_t))))
+	{
+		perror("malloc");
+		return NULL;
+	}
+	if (arena_init(&h->ws, arena_2d_size(n)) != 0)
+	{
+		free(h);
+		return NULL;
+	}
+	if (cholesky_factorize(&h->f, a, n, opts, &h->ws) != 0)
+	{
+		arena_destroy(&h->ws);
+		free(h);
+		return NULL;
+	}
+	return h;
+}
+
+
+void PREC_NAME(cholesky_factor_solve)(cholesky_handle_t *h, fptype *bb, int k, int ldb)
+{
+	cholesky_solve(&h->f, bb, k, ldb);
+}
+
+
+void PREC_NAME(cholesky_factor_destroy)(cholesky_handle_t *h)
+{
+	if (!h)
+		return;
+	cholesky_release(&h->f);
+	arena_destroy(&h->ws);
+	free(h);
+}
+
+
+/*
+ * Analyzes the pattern of a into a new sparse handle; returns NULL on
+ * failure. No numeric factor exists until cholesky_sparse_factorize().
+ */
+sparse_handle_t *PREC_NAME(cholesky_sparse_analyze)(csr_matrix_t *a, sparse_order order)
+{
+	sparse_handle_t *h;
+
+	if (!(h = (sparse_handle_t *) calloc(1, sizeof(sparse_handle_t))))
+	{
+		perror("calloc");
+		return NULL;
+	}
+	h->nnz = a->nnz;
+	h->row_ptr = (int64_t *) malloc((a->n + 1) * sizeof(int64_t));
+	h->col = (int32_t *) malloc((a->nnz + 1) * sizeof(int32_t));
+	if (!h->row_ptr || !h->col)
+	{
+		perror("malloc");
+		PREC_NAME(cholesky_sparse_destroy)(h);
+		return NULL;
+	}
+	memcpy(h->row_ptr, a->row_ptr, (a->n + 1) * sizeof(int64_t));
+	memcpy(h->col, a->col, a->nnz * sizeof(int32_t));
+	if (!(h->y = alloc_1d_matrix(a->n)) ||
+			sparse_symbolic(&h->sym, a, order) != 0)
+	{
+		PREC_NAME(cholesky_sparse_destroy)(h);
+		return NULL;
+	}
+	return h;
+}
+
+
+/*
+ * Factors a, which must have the pattern analyzed by h, with that
+ * analysis; the factor replaces the one of the previous call.
+ */
+int PREC_NAME(cholesky_sparse_factorize)(sparse_handle_t *h, csr_matrix_t *a)
+{
+	if (a->n != h->sym.n || a->nnz != h->nnz ||
+			memcmp(a->row_ptr, h->row_ptr, (a->n + 1) * sizeof(int64_t)) ||
+			memcmp(a->col, h->col, a->nnz * sizeof(int32_t)))
+	{
+		fprintf(stderr, "cholesky_sparse_factorize: A does not have the analyzed pattern\n");
+		return EXIT_FAILURE;
+	}
+	return sparse_numeric(&h->f, &h->sym, a);
+}
+
+
+/* Overwrites x with A^-1 * x, for the A factored last */
+void PREC_NAME(cholesky_sparse_solve)(sparse_handle_t *h, fptype *x)
+{
+	sparse_solve(&h->sym, &h->f, x, h->y);
+}
+
+
+void PREC_NAME(cholesky_sparse_destroy)(sparse_handle_t *h)
+{
+	if (!h)
+		return;
+	sparse_factor_free(&h->f);
+	sparse_symbolic_free(&h->sym);
+	free(h->row_ptr);
+	free(h->col);
+	free(h->y);
+	free(h);
+}
+
+
+/* Daemon state for the factorization options of opts (see daemon.h) */
+cholesky_server_t *PREC_NAME(cholesky_server_create)(solve_opts_t *opts)
+{
+	cholesky_server_t *s;
+
+	if (!(s = (cholesky_server_t *) calloc(1, sizeof(cholesky_server_t))))
+	{
+		perror("calloc");
+		return NULL;
+	}
+	s->opts = *opts;
+	s->opts.k = 1;
+	return s;
+}
+
+
+/*
+ * Solves A{sid} * x = b{sid} of order n with kernel alg (row, or tiled in
+ * the dense build), factoring A only if it is not cached. Returns 0, or
+ * EINVAL for a request this build cannot serve and ENOMEM if A cannot be
+ * factored.
+ */
+int PREC_NAME(cholesky_server_solve)(cholesky_server_t *s, int sid, int n,
+		factor_alg alg, fptype *x, server_stats_t *st)
+{
+	int i;
+	double t0, t1;
+	server_entry_t *e = NULL;
+
+#ifdef OPTIMIZED
+	if (alg != ALG_ROW)
+#else
+	if (alg != ALG_ROW && alg != ALG_TILED)
+#endif
+		return EINVAL;
+	if ((sid != S1 && sid != S2) || n < 3)
+		return EINVAL;
+
+	s->requests++;
+	st->cached = 0;
+	st->setup = 0;
+	for (i = 0; i < SERVER_CACHE; i++)
+	{
+		if (s->cache[i].sid == (sys_id) sid && s->cache[i].n == n &&
+				s->cache[i].alg == alg)
+		{
+			e = &s->cache[i];
+			st->cached = 1;
+			break;
+		}
+		if (!e || s->cache[i].used < e->used)
+			e = &s->cache[i];
+	}
+	if (!st->cached)
+	{
+		t0 = wall_time();
+		server_evict(e);
+		if (server_load(s, e, sid, n, alg) != 0)
+			return ENOMEM;
+		st->setup = wall_time() - t0;
+	}
+	e->used = s->requests;
+
+	t0 = wall_time();
+	memcpy(x, e->b, n * sizeof(fptype));
+	cholesky_solve(&e->h->f, x, 1, 1);
+	t1 = wall_time();
+	st->solve = t1 - t0;
+	return 0;
+}
+
+
+void PREC_NAME(cholesky_server_destroy)(cholesky_server_t *s)
+{
+	int i;
+
+	if (!s)
+		return;
+	for (i = 0; i < SERVER_CACHE; i++)
+		server_evict(&s->cache[i]);
+	free(s);
+}
+
+
+/* Generates A{sid} and b{sid} and keeps b and the factor of A in e */
+static int server_load(cholesky_server_t *s, server_entry_t *e, int sid,
+		int n, factor_alg alg)
+{
+	fptype **a1 = NULL, **a2 = NULL, *b1 = NULL, *b2 = NULL;
+
+	if (alloc_1d_matrices(n, 2, &b1, &b2) != 0)
+		return EXIT_FAILURE;
+	if (alloc_2d_matrices(n, 2, &a1, &a2) != 0)
+	{
+		free_1d_matrices(2, b1, b2);
+		return EXIT_FAILURE;
+	}
+	init_matrices(a1, a2, b1, b2, n);
+
+	s->opts.alg = alg;
+	e->h = PREC_NAME(cholesky_factor_create)(sid == S1 ? a1 : a2, n, &s->opts);
+	free_2d_matrices(n, 2, a1, a2);
+	if (!e->h)
+	{
+		free_1d_matrices(2, b1, b2);
+		return EXIT_FAILURE;
+	}
+	e->sid = (sys_id) sid;
+	e->n = n;
+	e->alg = alg;
+	if (sid == S1)
+	{
+		e->b = b1;
+		free(b2);
+	}
+	else
+	{
+		e->b = b2;
+		free(b1);
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static void server_evict(server_entry_t *e)
+{
+	PREC_NAME(cholesky_factor_destroy)(e->h);
+	free(e->b);
+	memset(e, 0, sizeof(server_entry_t));
+}
+
+
+/*
+ * Times cholesky_decomposition(), forward_substitution() and
+ * back_substitution() on A1 and b1, one after the other as in a solve:
+ * warmup untimed runs are followed by reps timed ones. res is indexed by
+ * bench_kernel.
+ */
+int PREC_NAME(cholesky_bench)(int n, int warmup, int reps, bench_result_t *res)
+{
+	int r, ret = EXIT_FAILURE;
+	fptype **a1  = NULL, **a2  = NULL,
+	        *b1  = NULL,  *b2  = NULL, **l, *x;
+	double *t, t0, t1, t2, t3, t4, elems, subst_flops;
+	arena_t ws;
+
+	if (alloc_1d_matrices(n, 2, &b1, &b2) != 0)
+		return EXIT_FAILURE;
+	if (alloc_2d_matrices(n, 2, &a1, &a2) != 0)
+	{
+		free_1d_matrices(2, b1, b2);
+		return EXIT_FAILURE;
+	}
+	init_matrices(a1, a2, b1, b2, n);
+	if (arena_init(&ws, arena_2d_size(n) + arena_1d_size(n)) != 0)
+		goto out_matrices;
+	if (!(t = (double *) malloc(NUM_BENCH_KERNELS * reps * sizeof(double))))
+	{
+		perror("malloc");
+		goto out_ws;
+	}
+
+	for (r = -warmup; r < reps; r++)
+	{
+		arena_reset(&ws);
+		t0 = wall_time();
+		l = cholesky_decomposition(a1, n, &ws);
+		t1 = wall_time();
+		if (!l || !(x = arena_alloc_1d(&ws, n)))
+			goto out;
+		memcpy(x, b1, n * sizeof(fptype));
+		t2 = wall_time();
+		forward_substitution(l, x, n, 1, 1);
+		t3 = wall_time();
+		back_substitution(l, x, n, 1, 1);
+		t4 = wall_time();
+		if (r < 0)
+			continue;
+		t[BENCH_DECOMPOSITION*reps + r] = t1 - t0;
+		t[BENCH_FORWARD*reps + r] = t3 - t2;
+		t[BENCH_BACK*reps + r] = t4 - t3;
+	}
+
+	/* Elements of L, and of the lower triangle of A, in the build's storage */
+#ifdef OPTIMIZED
+	elems = (double) n * (BANDWIDTH + 1);
+	subst_flops = (double) n * (2 * BANDWIDTH + 1);
+#else
+	elems = (double) n * (n + 1) / 2;
+	subst_flops = (double) n * n;
+#endif
+	res[BENCH_DECOMPOSITION].flops = cholesky_flops(n);
+	res[BENCH_DECOMPOSITION].bytes = 2 * elems * sizeof(fptype);
+	res[BENCH_FORWARD].flops = res[BENCH_BACK].flops = subst_flops;
+	res[BENCH_FORWARD].bytes = res[BENCH_BACK].bytes =
+			(elems + 2.0 * n) * sizeof(fptype);
+	for (r = 0; r < NUM_BENCH_KERNELS; r++)
+		bench_stats(&res[r], &t[r*reps], reps);
+	ret = EXIT_SUCCESS;
+out:
+	free(t);
+out_ws:
+	arena_destroy(&ws);
+out_matrices:
+	free_2d_matrices(n, 2, a1, a2);
+	free_1d_matrices(2, b1, b2);
+	return ret;
+}
+
+
+/* Median and 95th percentile (nearest rank) of reps run times, sorted in place */
+static void bench_stats(bench_result_t *res, double *t, int reps)
+{
+	qsort(t, reps, sizeof(double), bench_cmp);
+	res->median = (reps % 2) ? t[reps/2] : (t[reps/2-1] + t[reps/2]) / 2;
+	res->p95 = t[(int) ceil(0.95 * reps) - 1];
+}
+
+
+static int bench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+static int cholesky_factorize(cholesky_factor_t *f, fptype **a, int n,
+		solve_opts_t *opts, arena_t *ws)
+{
+#ifdef USE_FACTOR_CACHE
+	uint64_t hash = factor_cache_key(a, n);
+
+	if (factor_cache_load(f, a, hash, n, ws) == 0)
+		return EXIT_SUCCESS;
+#endif
+	f->n = n;
+	f->map = NULL;
+	f->map_size = 0;
+	if (opts->alg == ALG_TILED)
+		f->l = cholesky_decomposition_tiled(a, n, opts->threads, ws);
+	else
+		f->l = cholesky_decomposition(a, n, ws);
+	if (!f->l)
+		return EXIT_FAILURE;
+#ifdef USE_FACTOR_CACHE
+	factor_cache_store(f, a, hash);
+#endif
+	return EXIT_SUCCESS;
+}
+
+
+/* Floating-point operations of one factorization */
+static double cholesky_flops(int n)
+{
+#ifdef OPTIMIZED
+	return (double) n * (BANDWIDTH * BANDWIDTH + 3 * BANDWIDTH);
+#else
+	return (double) n * n * n / 3.0;
+#endif
+}
+
+
+/*
+ * Overwrites the n x k block bb (row i starts at bb + i*ldb) with
+ * A^-1 * bb, using the factor computed by cholesky_factorize().
+ */
+static void cholesky_solve(cholesky_factor_t *f, fptype *bb, int k, int ldb)
+{
+	forward_substitution(f->l, bb, f->n, k, ldb);
+	back_substitution(f->l, bb, f->n, k, ldb);
+}
+
+
+/* Unmaps a cached factor; factors computed in place live in the arena */
+static void cholesky_release(cholesky_factor_t *f)
+{
+	if (f->map)
+		munmap(f->map, f->map_size);
+	f->map = NULL;
+	f->l = NULL;
+}
+
+
+#ifdef USE_FACTOR_CACHE
+/*
+ * 64-bit FNV-1a hash of everything the factor depends on: n, the
+ * bandwidth, the size of fptype and the bytes of the stored elements of
+ * A, followed by the finalizer of MurmurHash3 so that every input bit
+ * reaches every bit of the key. A key only names the cache entry; a hit
+ * is confirmed against the copy of A stored in it.
+ */
+static uint64_t factor_cache_key(fptype **a, int n)
+{
+	int i, j;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int64_t meta[3] = {n, NUM_ROWS(n) - 1, sizeof(fptype)};
+
+	hash = fnv1a(hash, meta, sizeof(meta));
+	for (i = 0; i < NUM_ROWS(n); i++)
+		for (j = 0; j < n; j++)
+			hash = fnv1a(hash, &a[i][j], FP_VALUE_BYTES);
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	while (size--)
+		hash = (hash ^ *p++) * 0x100000001b3ULL;
+	return hash;
+}
+
+
+static void factor_cache_path(char *path, uint64_t hash)
+{
+	char *dir = getenv(FACTOR_CACHE_DIR_ENV);
+
+	snprintf(path, PATH_SIZE, "%s/cholesky-%016llx.bin",
+			(dir && *dir) ? dir : ".", (unsigned long long) hash);
+}
+
+
+/*
+ * Maps a cached factor read-only and points the rows of f->l straight
+ * into the mapping. Returns EXIT_FAILURE on a cache miss.
+ */
+static int factor_cache_load(cholesky_factor_t *f, fptype **a, uint64_t hash,
+		int n, arena_t *ws)
+{
+	int i, j, fd;
+	char path[PATH_SIZE];
+	struct stat st;
+	size_t size;
+	void *map;
+	factor_cache_hdr_t *hdr;
+	fptype *copy;
+
+	factor_cache_path(path, hash);
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return EXIT_FAILURE;
+
+	size = FACTOR_CACHE_HDR_SIZE + NUM_ROWS(n) * ROW_STRIDE(n) * sizeof(fptype) +
+			NUM_ROWS(n) * (size_t) n * sizeof(fptype);
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size != size)
+	{
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	hdr = (factor_cache_hdr_t *) map;
+	if (memcmp(hdr->magic, FACTOR_CACHE_MAGIC, sizeof(FACTOR_CACHE_MAGIC)) ||
+			hdr->version != FACTOR_CACHE_VERSION ||
+			hdr->fptype_size != sizeof(fptype) || hdr->hash != hash ||
+			hdr->n != n || hdr->rows != NUM_ROWS(n) ||
+			hdr->stride != (int64_t) ROW_STRIDE(n))
+	{
+		munmap(map, size);
+		return EXIT_FAILURE;
+	}
+
+	/* Another A with the same key is a miss */
+	copy = (fptype *) ((char *) map + FACTOR_CACHE_HDR_SIZE) + NUM_ROWS(n) * ROW_STRIDE(n);
+	for (i = 0; i < NUM_ROWS(n); i++)
+		for (j = 0; j < n; j++)
+			if (memcmp(&a[i][j], &copy[(size_t) i * n + j], FP_VALUE_BYTES))
+			{
+				munmap(map, size);
+				return EXIT_FAILURE;
+			}
+	if (!(f->l = (fptype **) arena_alloc(ws, NUM_ROWS(n) * sizeof(fptype *))))
+	{
+		munmap(map, size);
+		return EXIT_FAILURE;
+	}
+
+	f->l[0] = (fptype *) ((char *) map + FACTOR_CACHE_HDR_SIZE);
+	for (i = 1; i < NUM_ROWS(n); i++)
+		f->l[i] = f->l[i-1] + ROW_STRIDE(n);
+	f->n = n;
+	f->map = map;
+	f->map_size = size;
+	return EXIT_SUCCESS;
+}
+
+
+/*
+ * Writes f and the A it factors to the cache. The entry is written to a
+ * temporary file and renamed, so concurrent runs never map a partially
+ * written factor.
+ */
+static int factor_cache_store(cholesky_factor_t *f, fptype **a, uint64_t hash)
+{
+	int i, fd, ret, n = f->n;
+	char path[PATH_SIZE], tmp_path[PATH_SIZE + 32];
+	char hdr_buf[FACTOR_CACHE_HDR_SIZE];
+	factor_cache_hdr_t *hdr = (factor_cache_hdr_t *) hdr_buf;
+
+	memset(hdr_buf, 0, sizeof(hdr_buf));
+	memcpy(hdr->magic, FACTOR_CACHE_MAGIC, sizeof(FACTOR_CACHE_MAGIC));
+	hdr->version = FACTOR_CACHE_VERSION;
+	hdr->fptype_size = sizeof(fptype);
+	hdr->hash = hash;
+	hdr->n = n;
+	hdr->rows = NUM_ROWS(n);
+	hdr->stride = ROW_STRIDE(n);
+
+	factor_cache_path(path, hash);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long) getpid());
+	if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		perror("open");
+		return EXIT_FAILURE;
+	}
+
+	/* L is contiguous (see arena_alloc_2d()), so it is written in one go */
+	ret = write_full(fd, hdr_buf, FACTOR_CACHE_HDR_SIZE);
+	if (ret == 0)
+		ret = write_full(fd, f->l[0], NUM_ROWS(n) * ROW_STRIDE(n) * sizeof(fptype));
+	for (i = 0; ret == 0 && i < NUM_ROWS(n); i++)
+		ret = write_full(fd, a[i], n * sizeof(fptype));
+
+	if (close(fd) != 0)
+		ret = -1;
+	if (ret != 0 || rename(tmp_path, path) != 0)
+	{
+		perror("factor_cache_store");
+		unlink(tmp_path);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int write_full(int fd, const void *buf, size_t size)
+{
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < size; done += ret)
+		if ((ret = write(fd, (const char *) buf + done, size - done)) < 0)
+			return -1;
+	return 0;
+}
+#endif
+
+
+static fptype  **cholesky_decomposition(fptype **a, int n, arena_t *ws)
+{
+	fptype **l;
+#ifndef OPTIMIZED
+	int i, j, k;
+	fptype sum;
+#endif
+
+	TRACE_SCOPE("cholesky_decomposition");
+
+	if (!(l = arena_alloc_2d(ws, n)))
+		return NULL;
+
+#ifdef OPTIMIZED
+	band_factor(a, l, n);
+#else
+	for (i = 1; i <= n; i++)
+	{
+		for (j = 1; j <= i-1; j++)
+		{
+			sum = 0.0;
+			for (k = 1; k <= j-1; k++)
+			{
+				sum += l[i-1][k-1] * l[j-1][k-1];
+			}
+			l[i-1][j-1] = (a[i-1][j-1] - sum) / l[j-1][j-1];
+		}
+		sum = 0.0;
+		for (j = 1; j <= i-1; j++)
+		{
+			sum += l[i-1][j-1] * l[i-1][j-1];
+		}
+		l[i-1][i-1] = FP_SQRT(a[i-1][i-1] - sum);
+	}
 #endif
+	return l;
+}
 
-#ifdef PRINT_RESULTS
-	#ifndef PRINT_TOFILE
-	printf("\nWriting X%d...\n", sid);
-	#endif
-	snprintf(filename, BUFF_SIZE, "x%1d_%d.txt", sid, n);
-	write_1d_matrix(filename, x, n);
+
+#ifdef OPTIMIZED
+/* Band Cholesky factorization of A into l, which may hold anything */
+static void band_factor(fptype **a, fptype **l, int n)
+{
+	int i, j, k;
+	fptype sum;
+
+	/* l[i-j][i] holds L(i,j) and a[i-j][i] holds A(i,j) */
+	for (i = 0; i < n; i++)
+	{
+		for (j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; j < i; j++)
+		{
+			sum = 0.0;
+			for (k = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; k < j; k++)
+				sum += l[i-k][i] * l[j-k][j];
+			l[i-j][i] = (a[i-j][i] - sum) / l[0][j];
+		}
+		sum = 0.0;
+		for (j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; j < i; j++)
+			sum += l[i-j][i] * l[i-j][i];
+		l[0][i] = FP_SQRT(a[0][i] - sum);
+	}
+}
 #endif
 
-	free_2d_matrices(n, 2, l, l_trn);
-	free_1d_matrices(2, y, x);
+
+#ifdef OPTIMIZED
+static fptype **cholesky_decomposition_tiled(fptype **a, int n, int nthreads,
+		arena_t *ws)
+{
+	fprintf(stderr, "cholesky_decomposition_tiled: not available for band "
+			"storage!\n");
+	return NULL;
+}
+#else
+/*
+ * Tiled right-looking Cholesky factorization, run by nthreads workers that
+ * pick up tasks as soon as their input tiles are final.
+ */
+static fptype **cholesky_decomposition_tiled(fptype **a, int n, int nthreads,
+		arena_t *ws)
+{
+	int i, j, nt = (n + TILE_SIZE - 1) / TILE_SIZE;
+	fptype **l;
+	tile_sched_t s;
+	pthread_t *tids;
+
+	TRACE_SCOPE("cholesky_decomposition_tiled");
+
+	if (!(l = arena_alloc_2d(ws, n)))
+		return NULL;
+
+	/* Tasks update L in place, starting from the lower triangle of A */
+	for (i = 0; i < n; i++)
+		memcpy(l[i], a[i], (i+1) * sizeof(fptype));
+
+	memset(&s, 0, sizeof(s));
+	s.l = l;
+	s.n = n;
+	s.nt = nt;
+	s.ld = ROW_STRIDE(n);
+	/* Every tile has at most one ready task at a time */
+	s.qcap = nt * (nt+1) / 2;
+	s.updates = (int *) calloc((size_t) nt * nt, sizeof(int));
+	s.trsm_done = (char *) calloc((size_t) nt * nt, sizeof(char));
+	s.potrf_done = (char *) calloc(nt, sizeof(char));
+	s.queue = (tile_task_t *) malloc(s.qcap * sizeof(tile_task_t));
+	tids = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	if (!s.updates || !s.trsm_done || !s.potrf_done || !s.queue || !tids)
+	{
+		perror("malloc");
+		l = NULL;
+		goto out;
+	}
+	pthread_mutex_init(&s.lock, NULL);
+	pthread_cond_init(&s.ready, NULL);
+
+	tile_push(&s, TASK_POTRF, 0, 0, 0);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&tids[i], NULL, tile_worker, &s) != 0)
+		{
+			perror("pthread_create");
+			break;
+		}
+	if (i == 0)
+		tile_worker(&s);
+	while (--i >= 0)
+		pthread_join(tids[i], NULL);
+
+	pthread_cond_destroy(&s.ready);
+	pthread_mutex_destroy(&s.lock);
+
+	/* UPDATE tasks on diagonal tiles also write above the diagonal */
+	for (i = 0; i < n; i++)
+		for (j = i+1; j < n && j < (i / TILE_SIZE + 1) * TILE_SIZE; j++)
+			l[i][j] = 0.0;
+out:
+	free(s.updates);
+	free(s.trsm_done);
+	free(s.potrf_done);
+	free(s.queue);
+	free(tids);
+	return l;
 }
 
 
-fptype  **cholesky_decomposition(fptype **a, int n)
+static void *tile_worker(void *arg)
 {
-	int i, j, k;
-	fptype sum, **l;
+	tile_sched_t *s = (tile_sched_t *) arg;
+	tile_task_t t;
+	fptype *bt;
 
-	if (!(l = alloc_2d_matrix(n)))
+	/* Per-worker buffer for the packed transpose of L(j,k) */
+	if (!(bt = (fptype *) alloc_aligned(TILE_SIZE * TILE_SIZE * sizeof(fptype))))
 		return NULL;
 
-	for (i = 1; i <= n; i++)
+	pthread_mutex_lock(&s->lock);
+	for (;;)
 	{
-#ifdef OPTIMIZED
-		for (j = (i-2 >= 1) ? i-2 : 1; j <= i-1; j++)
-#else
-		for (j = 1; j <= i-1; j++)
-#endif
+		while (s->qlen == 0 && !s->finished)
+			pthread_cond_wait(&s->ready, &s->lock);
+		if (s->qlen == 0)
+			break;
+		t = s->queue[s->qhead];
+		s->qhead = (s->qhead + 1) % s->qcap;
+		s->qlen--;
+		pthread_mutex_unlock(&s->lock);
+
+		switch (t.type)
 		{
-			sum = 0.0;
-#ifdef OPTIMIZED
-			for (k = (j-2 >= 1) ? j-2 : 1; k <= j-1; k++)
-#else
-			for (k = 1; k <= j-1; k++)
-#endif
+			case TASK_POTRF:
+				tile_potrf(s, t.k);
+				break;
+			case TASK_TRSM:
+				tile_trsm(s, t.i, t.k);
+				break;
+			case TASK_UPDATE:
+				tile_update(s, t.i, t.j, t.k, bt);
+				break;
+		}
+
+		pthread_mutex_lock(&s->lock);
+		tile_complete(s, &t);
+	}
+	pthread_mutex_unlock(&s->lock);
+	free(bt);
+	return NULL;
+}
+
+
+/*
+ * Queues a ready task (s->lock held). POTRF and TRSM tasks are on the
+ * critical path, so they go to the front of the queue.
+ */
+static void tile_push(tile_sched_t *s, tile_task_type type, int i, int j, int k)
+{
+	tile_task_t t = {type, i, j, k};
+
+	if (type == TASK_UPDATE)
+		s->queue[(s->qhead + s->qlen) % s->qcap] = t;
+	else
+	{
+		s->qhead = (s->qhead + s->qcap - 1) % s->qcap;
+		s->queue[s->qhead] = t;
+	}
+	s->qlen++;
+	pthread_cond_signal(&s->ready);
+}
+
+
+/*
+ * Records the completion of t and queues the tasks it made ready
+ * (s->lock held). Each readiness condition is completed by exactly one
+ * task, so no task is queued twice.
+ */
+static void tile_complete(tile_sched_t *s, tile_task_t *t)
+{
+	int i, nt = s->nt, k = t->k;
+
+	switch (t->type)
+	{
+		case TASK_POTRF:
+			s->potrf_done[k] = 1;
+			if (k == nt-1)
 			{
-				sum += l[i-1][k-1] * l[j-1][k-1];
+				s->finished = 1;
+				pthread_cond_broadcast(&s->ready);
 			}
-			l[i-1][j-1] = (a[i-1][j-1] - sum) / l[j-1][j-1];
+			for (i = k+1; i < nt; i++)
+				if (s->updates[i*nt + k] == k)
+					tile_push(s, TASK_TRSM, i, k, k);
+			break;
+		case TASK_TRSM:
+			s->trsm_done[t->i*nt + k] = 1;
+			/* Tiles (t->i, j) in row t->i, including diagonal tile (t->i, t->i) */
+			for (i = k+1; i <= t->i; i++)
+				if (s->trsm_done[i*nt + k] && s->updates[t->i*nt + i] == k)
+					tile_push(s, TASK_UPDATE, t->i, i, k);
+			/* Tiles (i, t->i) below the diagonal */
+			for (i = t->i+1; i < nt; i++)
+				if (s->trsm_done[i*nt + k] && s->updates[i*nt + t->i] == k)
+					tile_push(s, TASK_UPDATE, i, t->i, k);
+			break;
+		case TASK_UPDATE:
+			s->updates[t->i*nt + t->j] = k+1;
+			if (k+1 == t->j)
+			{
+				/* Tile (i,j) is final: factor or solve it */
+				if (t->i == t->j)
+					tile_push(s, TASK_POTRF, t->j, t->j, t->j);
+				else if (s->potrf_done[t->j])
+					tile_push(s, TASK_TRSM, t->i, t->j, t->j);
+			}
+			else if (s->trsm_done[t->i*nt + k+1] && s->trsm_done[t->j*nt + k+1])
+				tile_push(s, TASK_UPDATE, t->i, t->j, k+1);
+			break;
+	}
+}
+
+
+/* Row Cholesky factorization of diagonal tile (k,k) */
+static void tile_potrf(tile_sched_t *s, int k)
+{
+	int i, j, m, kb = k * TILE_SIZE,
+	    ke = (kb + TILE_SIZE < s->n) ? kb + TILE_SIZE : s->n;
+	fptype sum, **l = s->l;
+
+	TRACE_SCOPE("tile_potrf");
+
+	for (i = kb; i < ke; i++)
+	{
+		for (j = kb; j < i; j++)
+		{
+			for (m = kb, sum = 0.0; m < j; m++)
+				sum += l[i][m] * l[j][m];
+			l[i][j] = (l[i][j] - sum) / l[j][j];
 		}
-		sum = 0.0;
-#ifdef OPTIMIZED
-		for (j = (i-2 >= 1) ? i-2 : 1; j <= i-1; j++)
-#else
-		for (j = 1; j <= i-1; j++)
-#endif
+		for (m = kb, sum = 0.0; m < i; m++)
+			sum += l[i][m] * l[i][m];
+		l[i][i] = FP_SQRT(l[i][i] - sum);
+	}
+}
+
+
+/* L(i,k) = A(i,k) * L(k,k)^-T */
+static void tile_trsm(tile_sched_t *s, int i, int k)
+{
+	int r, c, m, kb = k * TILE_SIZE, ke = kb + TILE_SIZE, ib = i * TILE_SIZE,
+	    ie = (ib + TILE_SIZE < s->n) ? ib + TILE_SIZE : s->n;
+	fptype sum, **l = s->l;
+
+	TRACE_SCOPE("tile_trsm");
+
+	for (r = ib; r < ie; r++)
+	{
+		for (c = kb; c < ke; c++)
 		{
-			sum += l[i-1][j-1] * l[i-1][j-1];
+			for (m = kb, sum = 0.0; m < c; m++)
+				sum += l[r][m] * l[c][m];
+			l[r][c] = (l[r][c] - sum) / l[c][c];
 		}
-#ifdef FPTYPE_DOUBLE
-		l[i-1][i-1] = sqrt(a[i-1][i-1] - sum);
-#else
-		l[i-1][i-1] = sqrtf(a[i-1][i-1] - sum);
+	}
+}
+
+
+/*
+ * A(i,j) -= L(i,k) * L(j,k)^T. L(j,k) is first packed transposed into bt,
+ * so the micro-kernel streams contiguous vectors of it; rows and columns
+ * left over by the MR x NR register blocks are updated one by one.
+ */
+static void tile_update(tile_sched_t *s, int i, int j, int k, fptype *bt)
+{
+	int r, c, m, p, q, kb = k * TILE_SIZE, jb = j * TILE_SIZE, ib = i * TILE_SIZE,
+	    je = (jb + TILE_SIZE < s->n) ? jb + TILE_SIZE : s->n,
+	    ie = (ib + TILE_SIZE < s->n) ? ib + TILE_SIZE : s->n;
+	fptype sum, **l = s->l;
+
+	TRACE_SCOPE("tile_update");
+
+	for (c = jb; c < je; c++)
+		for (m = 0; m < TILE_SIZE; m++)
+			bt[m*TILE_SIZE + c-jb] = l[c][kb+m];
+
+	for (r = ib; r < ie; r += MR)
+	{
+		/* On diagonal tiles only blocks reaching the lower triangle matter */
+		c = jb;
+		if (r + MR <= ie)
+			for (; c + NR <= je && (i != j || c < r + MR); c += NR)
+				tile_microkernel(&l[r][c], s->ld, &l[r][kb], s->ld,
+						bt + c-jb, TILE_SIZE, TILE_SIZE);
+		for (m = r; m < r + MR && m < ie; m++)
+			for (p = c; p < ((i == j) ? m+1 : je); p++)
+			{
+				for (q = kb, sum = 0.0; q < kb + TILE_SIZE; q++)
+					sum += l[m][q] * l[p][q];
+				l[m][p] -= sum;
+			}
+	}
+}
+
+
+/*
+ * C -= A * Bt for an MR x NR block of C, where A is MR x kc and Bt is the
+ * packed kc x NR transpose of the second operand. The block is kept in
+ * MR x 2 vector registers for the whole reduction.
+ */
+static void tile_microkernel(fptype *c, int ldc, fptype *a, int lda,
+		fptype *bt, int ldb, int kc)
+{
+	int p, m;
+	fpvec acc[MR][2], b0, b1, cv;
+
+	memset(acc, 0, sizeof(acc));
+	for (m = 0; m < kc; m++)
+	{
+		memcpy(&b0, bt + m*ldb, sizeof(fpvec));
+		memcpy(&b1, bt + m*ldb + VEC_LANES, sizeof(fpvec));
+		for (p = 0; p < MR; p++)
+		{
+			acc[p][0] += a[p*lda + m] * b0;
+			acc[p][1] += a[p*lda + m] * b1;
+		}
+	}
+	for (p = 0; p < MR; p++)
+	{
+		memcpy(&cv, c + p*ldc, sizeof(fpvec));
+		cv -= acc[p][0];
+		memcpy(c + p*ldc, &cv, sizeof(fpvec));
+		memcpy(&cv, c + p*ldc + VEC_LANES, sizeof(fpvec));
+		cv -= acc[p][1];
+		memcpy(c + p*ldc + VEC_LANES, &cv, sizeof(fpvec));
+	}
+}
 #endif
+
+
+#ifdef OPTIMIZED
+/*
+ * Batched solve of count independent systems, where system s is
+ * A1 * x = b1 for even s and A2 * x = b2 for odd s. The systems are solved
+ * in groups of BATCH_LANES, stored interleaved (element (i, i-d) of
+ * system g+v at band[d*n + i][v]) so that every operation of the band
+ * recurrences works on the whole group. The same systems are also solved
+ * one by one for comparison, and the lanes of the last group are checked
+ * against these scalar solutions.
+ */
+static void solve_batch(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n,
+		int count, arena_t *ws)
+{
+	int s, g, i, d, v;
+	size_t mark;
+	fptype **l, *xs[2], **as[BATCH_LANES], *bs[BATCH_LANES], diff, err = 0;
+	fpbatch *band, *x;
+	double t0, t1, t2;
+
+	arena_reset(ws);
+	if (!(band = (fpbatch *) arena_alloc(ws, (BANDWIDTH+2) * n * sizeof(fpbatch))) ||
+			!(xs[0] = arena_alloc_1d(ws, n)) || !(xs[1] = arena_alloc_1d(ws, n)))
+		return;
+	x = band + (BANDWIDTH+1) * n;
+
+	/* One system at a time; L is handed back to ws after every solve */
+	t0 = wall_time();
+	mark = ws->used;
+	for (s = 0; s < count; s++)
+	{
+		if (!(l = cholesky_decomposition((s % 2) ? a2 : a1, n, ws)))
+			return;
+		memcpy(xs[s % 2], (s % 2) ? b2 : b1, n * sizeof(fptype));
+		forward_substitution(l, xs[s % 2], n, 1, 1);
+		back_substitution(l, xs[s % 2], n, 1, 1);
+		ws->used = mark;
+	}
+	t1 = wall_time();
+
+	for (g = 0; g < count; g += BATCH_LANES)
+	{
+		/* Gather: the elements of all lanes of a vector are stored together */
+		for (v = 0; v < BATCH_LANES; v++)
+		{
+			as[v] = ((g+v) % 2) ? a2 : a1;
+			bs[v] = ((g+v) % 2) ? b2 : b1;
+		}
+		for (d = 0; d <= BANDWIDTH; d++)
+			for (i = 0; i < n; i++)
+				for (v = 0; v < BATCH_LANES; v++)
+					LANE(band[d*n + i], v) = as[v][d][i];
+		for (i = 0; i < n; i++)
+			for (v = 0; v < BATCH_LANES; v++)
+				LANE(x[i], v) = bs[v][i];
+		batch_cholesky_solve(band, x, n);
+	}
+	t2 = wall_time();
+
+	/* Lanes past count (in the last group) solve padding systems */
+	for (v = 0; v < BATCH_LANES && g - BATCH_LANES + v < count; v++)
+	{
+		for (i = 0; i < n; i++)
+		{
+			diff = FP_ABS(LANE(x[i], v) - xs[(g - BATCH_LANES + v) % 2][i]);
+			if (diff > err || isnan(diff))
+				err = diff;
+		}
+	}
+
+	printf("\nBatch: %d systems, %d lanes, %.6f s (%.0f systems/s); "
+			"scalar: %.6f s (%.0f systems/s); max |x - x_scalar| = %g\n",
+			count, BATCH_LANES, t2 - t1, count / (t2 - t1), t1 - t0,
+			count / (t1 - t0), (double) err);
+}
+
+
+/*
+ * Factors every system of an interleaved group in place (band then holds
+ * L, stored like A) and overwrites x with A^-1 * x. The forward
+ * substitution runs in the same sweep as the factorization, while row i
+ * of L is still in cache. Operations are done in the order of
+ * cholesky_decomposition() and the substitutions, so every lane matches
+ * the scalar solution of its system.
+ */
+static void batch_cholesky_solve(fpbatch *band, fpbatch *x, int n)
+{
+	int i, j, k, lo;
+	const fpbatch zero = {0};
+	fpbatch sum;
+
+	for (i = 0; i < n; i++)
+	{
+		lo = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0;
+		for (j = lo; j < i; j++)
+		{
+			sum = zero;
+			for (k = lo; k < j; k++)
+				sum += band[(i-k)*n + i] * band[(j-k)*n + j];
+			band[(i-j)*n + i] = (band[(i-j)*n + i] - sum) / band[j];
+		}
+		sum = zero;
+		for (j = lo; j < i; j++)
+			sum += band[(i-j)*n + i] * band[(i-j)*n + i];
+		band[i] -= sum;
+		batch_sqrt(&band[i]);
+
+		/* L * y = b */
+		for (j = lo; j < i; j++)
+			x[i] -= band[(i-j)*n + i] * x[j];
+		x[i] /= band[i];
+	}
+
+	/* L^T * x = y */
+	for (i = n-1; i >= 0; i--)
+	{
+		for (j = (i+BANDWIDTH < n) ? i+BANDWIDTH : n-1; j > i; j--)
+			x[i] -= band[(j-i)*n + j] * x[j];
+		x[i] /= band[i];
 	}
-	return l;
 }
 
 
+/*
+ * Lane-wise square root, in place; there is no generic vector one, but
+ * with -fno-math-errno the loop is vectorized.
+ */
+static void batch_sqrt(fpbatch *x)
+{
+	int v;
+
+	for (v = 0; v < BATCH_LANES; v++)
+		LANE(*x, v) = FP_SQRT(LANE(*x, v));
+}
+#else
+static void solve_batch(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n,
+		int count, arena_t *ws)
+{
+	fprintf(stderr, "solve_batch: not available for dense storage!\n");
+}
+#endif
+
 #ifdef VERIFY_CHOLESKY_DECOMP
-void verify_cholesky_decomposition(fptype **l, int n, sys_id sid)
+static void verify_cholesky_decomposition(fptype **l, int n, sys_id sid,
+		output_fmt fmt)
 {
 	int i, j, k;
 	fptype **ra, sum;
@@ -457,6 +4235,18 @@ void verify_cholesky_decomposition(fptype **l, int n, sys_id sid)
 	}
 
 	/* Calculate L * L-transpose */
+#ifdef OPTIMIZED
+	/* Only the band of the product is non-zero: ra[d][i] = (L*L^T)(i,i-d) */
+	for (i = 0; i < n; i++)
+	{
+		for (j = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; j <= i; j++)
+		{
+			for (k = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0, sum = 0.0; k <= j; k++)
+				sum += l[i-k][i] * l[j-k][j];
+			ra[i-j][i] = sum;
+		}
+	}
+#else
 	for (i = 0; i < n; i++)
 	{
 		for (j = 0; j < n; j++)
@@ -466,87 +4256,220 @@ void verify_cholesky_decomposition(fptype **l, int n, sys_id sid)
 			ra[i][j] = sum;
 		}
 	}
+#endif
 
 	#ifndef PRINT_TOFILE
 	printf("\nWriting A%d = L%d * L%d^T...\n", sid, sid, sid);
 	#endif
 	snprintf(filename, BUFF_SIZE, "ra%1d_%d.txt", sid , n);
-	write_2d_matrix(filename, ra, n);
+	write_2d_matrix(filename, ra, n, fmt);
 	free_2d_matrix(ra, n);
 }
 #endif
 
 
-fptype **transpose(fptype **mat, int n)
+/*
+ * Verification cheap enough to leave on (-v): L has the band of A, so
+ * A - L * L^T and r = b - A * x need only be formed over that band, in
+ * O(n * bandwidth). One line reports the largest element of A - L * L^T,
+ * also relative to the largest of A, ||r||_inf, also relative to
+ * ||b||_inf, and the normwise backward error of x,
+ * ||r||_inf / (||A||_inf * ||x||_inf + ||b||_inf).
+ */
+static void verify_solution(fptype **a, fptype **l, fptype *b, fptype *x, int n,
+		sys_id sid)
 {
-	int i, j;
-	fptype **trn;
+	int i, j, k, bw = lower_bandwidth(a, n);
+	fptype *r, *rowsum, sum, aij, emax = 0, amax = 0, rnorm = 0, bnorm = 0,
+	       xnorm = 0, anorm = 0;
 
-	if (!(trn = alloc_2d_matrix(n)))
-		return NULL;
+	if (!(r = alloc_1d_matrix(n)) || !(rowsum = alloc_1d_matrix(n)))
+	{
+		free(r);
+		printf("[WARNING]: Couldn't verify the solution of system %d\n", sid);
+		return;
+	}
 
-#ifdef OPTIMIZED
+	/* A(i,j) = A(j,i) enters both row i and row j of A * x */
+	for (i = 0; i < n; i++)
+		r[i] = b[i];
+	for (i = 0; i < n; i++)
+	{
+		for (j = (i-bw >= 0) ? i-bw : 0; j <= i; j++)
+		{
+			aij = LOWER(a, i, j);
+			for (k = (i-bw >= 0) ? i-bw : 0, sum = 0; k <= j; k++)
+				sum += LOWER(l, i, k) * LOWER(l, j, k);
+			if (FP_ABS(aij - sum) > emax || isnan(aij - sum))
+				emax = FP_ABS(aij - sum);
+			if (FP_ABS(aij) > amax)
+				amax = FP_ABS(aij);
+			r[i] -= aij * x[j];
+			rowsum[i] += FP_ABS(aij);
+			if (j < i)
+			{
+				r[j] -= aij * x[i];
+				rowsum[j] += FP_ABS(aij);
+			}
+		}
+	}
 	for (i = 0; i < n; i++)
-		for (j = (i-2 >= 0) ? i-2 : 0; j < n; j++)
-			trn[i][j] = mat[j][i];
+	{
+		if (FP_ABS(r[i]) > rnorm || isnan(r[i]))
+			rnorm = FP_ABS(r[i]);
+		if (FP_ABS(x[i]) > xnorm || isnan(x[i]))
+			xnorm = FP_ABS(x[i]);
+		if (FP_ABS(b[i]) > bnorm)
+			bnorm = FP_ABS(b[i]);
+		if (rowsum[i] > anorm)
+			anorm = rowsum[i];
+	}
+
+	printf("\nSystem %d: max |A - LL^T| = %.3e (relative %.3e), "
+			"||b - Ax|| = %.3e (relative %.3e), backward error %.3e\n",
+			sid, (double) emax, (double) (emax / amax), (double) rnorm,
+			(double) (rnorm / bnorm), (double) (rnorm / (anorm * xnorm + bnorm)));
+	free(r);
+	free(rowsum);
+}
+
+
+/*
+ * Lower bandwidth of A: BANDWIDTH in band storage; in dense storage the
+ * rows are scanned up to the band found so far, which reads every element
+ * outside the band once but stays far cheaper than the factorization.
+ */
+static int lower_bandwidth(fptype **a, int n)
+{
+#ifdef OPTIMIZED
+	return BANDWIDTH;
 #else
+	int i, j, bw = 0;
+
 	for (i = 0; i < n; i++)
-		for (j = 0; j < n; j++)
-			trn[i][j] = mat[j][i];
+		for (j = 0; j < i-bw; j++)
+			if (a[i][j] != 0)
+			{
+				bw = i-j;
+				break;
+			}
+	return bw;
 #endif
-	return trn;
 }
 
 
-fptype *forward_substitution(fptype **l, fptype *b, int n)
+/*
+ * Overwrites the n x k block bb (row i starts at bb + i*ldb) with
+ * L^-1 * bb. The columns are swept RHS_BLOCK at a time, so the rows of the
+ * tile being reused stay in cache and the innermost loops run over
+ * contiguous right-hand sides.
+ */
+static void forward_substitution(fptype **l, fptype *bb, int n, int k, int ldb)
 {
-	int i, k;
-	fptype *y, sum;
+	int i, m, c, w;
+	fptype *yi;
 
-	if (!(y = alloc_1d_matrix(n)))
-		return NULL;
+	TRACE_SCOPE("forward_substitution");
 
-	for (i = 0; i < n; i++)
+	for (c = 0; c < k; c += RHS_BLOCK)
 	{
-		sum = b[i];
+		w = (k-c < RHS_BLOCK) ? k-c : RHS_BLOCK;
+		for (i = 0; i < n; i++)
+		{
+			yi = bb + (size_t) i*ldb + c;
 #ifdef OPTIMIZED
-		for (k = (i-2 >= 0) ? i-2 : 0; k < i; k++)
+			for (m = (i-BANDWIDTH >= 0) ? i-BANDWIDTH : 0; m < i; m++)
+				block_axpy(yi, -l[i-m][i], bb + (size_t) m*ldb + c, w);
+			block_divide(yi, l[0][i], w);
 #else
-		for (k = 0; k < i; k++)
+			for (m = 0; m < i; m++)
+				block_axpy(yi, -l[i][m], bb + (size_t) m*ldb + c, w);
+			block_divide(yi, l[i][i], w);
 #endif
-			sum -= l[i][k] * y[k];
-		y[i] = sum / l[i][i];
+		}
 	}
-
-	return y;
 }
 
 
-fptype *back_substitution(fptype **l, fptype *b, int n)
+/*
+ * Overwrites the n x k block bb with L^-T * bb, where l holds the lower
+ * triangular factor L. L^T is never formed: element (i,m) of L^T is read
+ * as element (m,i) of L.
+ */
+static void back_substitution(fptype **l, fptype *bb, int n, int k, int ldb)
 {
-	int i, k;
-	fptype *y, sum;
+	int i, m, c, w;
+	fptype *yi;
 
-	if (!(y = alloc_1d_matrix(n)))
-		return NULL;
+	TRACE_SCOPE("back_substitution");
 
-	for (i = n; i >= 1; i--)
+	for (c = 0; c < k; c += RHS_BLOCK)
 	{
-		sum = b[i-1];
+		w = (k-c < RHS_BLOCK) ? k-c : RHS_BLOCK;
+		for (i = n-1; i >= 0; i--)
+		{
+			yi = bb + (size_t) i*ldb + c;
 #ifdef OPTIMIZED
-		for (k = (i+2 <= n) ? i+2 : n; k >= i+1; k--)
+			for (m = (i+BANDWIDTH < n) ? i+BANDWIDTH : n-1; m > i; m--)
+				block_axpy(yi, -l[m-i][m], bb + (size_t) m*ldb + c, w);
+			block_divide(yi, l[0][i], w);
 #else
-		for (k = n; k >= i+1; k--)
+			/*
+			 * Column-oriented sweep: column i of L^T is row i of L, so
+			 * once row i of the solution is known its contribution is
+			 * subtracted from all preceding rows while walking row i
+			 * of L contiguously.
+			 */
+			block_divide(yi, l[i][i], w);
+			for (m = 0; m < i; m++)
+				block_axpy(bb + (size_t) m*ldb + c, -l[i][m], yi, w);
 #endif
-			sum -= l[i-1][k-1] * y[k-1];
-		y[i-1] = sum / l[i-1][i-1];
+		}
 	}
+}
+
+
+/*
+ * y += s * x, for a tile of w <= RHS_BLOCK right-hand sides. Full tiles
+ * have a constant trip count, so the compiler can vectorize them.
+ */
+static void block_axpy(fptype *y, fptype s, fptype *x, int w)
+{
+	int j;
+
+	if (w == RHS_BLOCK)
+		for (j = 0; j < RHS_BLOCK; j++)
+			y[j] += s * x[j];
+	else
+		for (j = 0; j < w; j++)
+			y[j] += s * x[j];
+}
+
+
+/* y /= s, for a tile of w <= RHS_BLOCK right-hand sides */
+static void block_divide(fptype *y, fptype s, int w)
+{
+	int j;
+
+	if (w == RHS_BLOCK)
+		for (j = 0; j < RHS_BLOCK; j++)
+			y[j] /= s;
+	else
+		for (j = 0; j < w; j++)
+			y[j] /= s;
+}
+
+
+static double wall_time(void)
+{
+	struct timespec ts;
 
-	return y;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 
-void free_1d_matrices(int num_args, ...)
+static void free_1d_matrices(int num_args, ...)
 {
 	va_list args;
 	fptype *ptr;
@@ -562,7 +4485,7 @@ void free_1d_matrices(int num_args, ...)
 }
 
 
-void free_2d_matrices(int n, int num_args, ...)
+static void free_2d_matrices(int n, int num_args, ...)
 {
 	va_list args;
 	fptype **ptr;
@@ -578,15 +4501,12 @@ void free_2d_matrices(int n, int num_args, ...)
 }
 
 
-void free_2d_matrix(fptype **mat, int n)
+static void free_2d_matrix(fptype **mat, int n)
 {
-	int i;
-
 	if (!mat)
 		return;
 
-	for (i = 0; i < n; i++)
-		free(mat[i]);
+	free(mat[0]);
 	free(mat);
 }
 
@@ -0,0 +1,108 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+#include "binfmt.h"
+#include "csr.h"
+
+typedef enum {ALG_ROW, ALG_TILED, ALG_SPIKE, ALG_SKYLINE, ALG_TOEPLITZ} factor_alg;
+typedef enum {PREC_FLOAT, PREC_DOUBLE, PREC_LDOUBLE} precision;
+typedef enum {ORDER_ND, ORDER_NATURAL} sparse_order;
+
+/* Run-time options of solve_system() */
+typedef struct {
+	int         k;          /* Right-hand sides per system */
+	factor_alg  alg;        /* Factorization kernel */
+	int         threads;    /* Worker threads of the solvers and the .mtx parser */
+	int         mixed;      /* Factor in float and refine in fptype */
+	int         batch;      /* Independent systems solved as a batch, or 0 */
+	const char *spill;      /* Out of core: file L is spilled to, or NULL */
+	output_fmt  out;        /* Format of the vectors and matrices written */
+	const char *input;      /* Sparse matrix file solved instead of A1, A2, or NULL */
+	int         verify;     /* Print the errors of L and x, see verify_solution() */
+	sparse_order order;     /* Fill-reducing ordering of sparse solves */
+} solve_opts_t;
+
+/* Kernels timed by cholesky_bench() */
+typedef enum {BENCH_DECOMPOSITION, BENCH_FORWARD, BENCH_BACK, NUM_BENCH_KERNELS} bench_kernel;
+
+/* Run time of a kernel over the timed runs, and the work of one run */
+typedef struct {
+	double  median;         /* Seconds */
+	double  p95;
+	double  flops;
+	double  bytes;          /* Every operand read or written once */
+} bench_result_t;
+
+/* Outcome of a cholesky_server_solve() request */
+typedef struct {
+	int     cached;         /* The factor of A was reused */
+	double  setup;          /* Seconds generating and factoring A, 0 if cached */
+	double  solve;          /* Seconds of the triangular solves */
+} server_stats_t;
+
+/*
+ * cholesky.c is compiled once per precision; each instance exports its
+ * entry point, a factorization handle API and the daemon state of -d for
+ * its own fptype, with a suffix naming that fptype. Matrices use the
+ * storage of the build (band or dense) and a handle owns its workspace, so
+ * handles of different precisions can be used side by side.
+ *
+ * A sparse handle holds the symbolic analysis of a CSR matrix of csr.h,
+ * which depends on its pattern only: cholesky_sparse_factorize() can then
+ * be called for every matrix with that pattern (it fails for another
+ * pattern, or for a matrix that is not positive definite), each time
+ * replacing the numeric factor that cholesky_sparse_solve() uses.
+ */
+#define CHOLESKY_DECLARE(T, S)                                                  \
+	typedef struct cholesky_handle##S cholesky_handle##S;                   \
+	typedef struct cholesky_server##S cholesky_server##S;                   \
+	typedef struct cholesky_sparse##S cholesky_sparse##S;                   \
+	int                  cholesky_run##S(int n, solve_opts_t *opts);         \
+	T                  **cholesky_matrix_alloc##S(int n);                    \
+	void                 cholesky_matrix_free##S(T **a, int n);              \
+	cholesky_handle##S  *cholesky_factor_create##S(T **a, int n,             \
+	                             solve_opts_t *opts);                        \
+	void                 cholesky_factor_solve##S(cholesky_handle##S *h,     \
+	                             T *bb, int k, int ldb);                     \
+	void                 cholesky_factor_destroy##S(cholesky_handle##S *h);  \
+	cholesky_sparse##S  *cholesky_sparse_analyze##S(csr_matrix##S *a,        \
+	                             sparse_order order);                        \
+	int                  cholesky_sparse_factorize##S(cholesky_sparse##S *h, \
+	                             csr_matrix##S *a);                          \
+	void                 cholesky_sparse_solve##S(cholesky_sparse##S *h,     \
+	                             T *x);                                      \
+	void                 cholesky_sparse_destroy##S(cholesky_sparse##S *h);  \
+	int                  cholesky_bench##S(int n, int warmup, int reps,      \
+	                             bench_result_t *res);                       \
+	cholesky_server##S  *cholesky_server_create##S(solve_opts_t *opts);      \
+	int                  cholesky_server_solve##S(cholesky_server##S *s,     \
+	                             int sys, int n, factor_alg alg, T *x,       \
+	                             server_stats_t *st);                        \
+	void                 cholesky_server_destroy##S(cholesky_server##S *s);
+
+CHOLESKY_DECLARE(float, _f)
+CHOLESKY_DECLARE(double, _d)
+CHOLESKY_DECLARE(long double, _ld)
+
+#endif
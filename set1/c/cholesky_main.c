@@ -0,0 +1,348 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "cholesky.h"
+#include "daemon.h"
+
+/* Daemon mode (-d): the state of every precision, created on first use */
+typedef struct {
+	solve_opts_t        *opts;
+	cholesky_server_f   *f;
+	cholesky_server_d   *d;
+	cholesky_server_ld  *ld;
+	void                *x;
+	size_t               x_size;
+} daemon_state_t;
+
+/* Function Prototypes */
+static void  serve_request(const daemon_req_t *req, daemon_resp_t *resp,
+		const void **x, void *arg);
+
+
+int main(int argc, char **argv)
+{
+	int n, opt, usage = 0;
+	precision prec = PREC_DOUBLE;
+	solve_opts_t opts = {1, ALG_ROW, 0, 0, 0, NULL, OUT_TEXT, NULL, 0, ORDER_ND};
+	const char *socket_path = NULL;
+	daemon_state_t state;
+
+	while ((opt = getopt(argc, argv, "a:B:d:f:i:mo:O:p:t:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a':
+				if (!strcmp(optarg, "row"))
+					opts.alg = ALG_ROW;
+				else if (!strcmp(optarg, "tiled"))
+					opts.alg = ALG_TILED;
+				else if (!strcmp(optarg, "spike"))
+					opts.alg = ALG_SPIKE;
+				else if (!strcmp(optarg, "skyline"))
+					opts.alg = ALG_SKYLINE;
+				else if (!strcmp(optarg, "toeplitz"))
+					opts.alg = ALG_TOEPLITZ;
+				else
+				{
+					fprintf(stderr, "Unknown factorization kernel: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'B':
+				if ((opts.batch = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of batched systems should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'd':
+				socket_path = optarg;
+				break;
+			case 'f':
+				if (!strcmp(optarg, "text"))
+					opts.out = OUT_TEXT;
+				else if (!strcmp(optarg, "binary"))
+					opts.out = OUT_BINARY;
+				else
+				{
+					fprintf(stderr, "Unknown output format: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'i':
+				opts.input = optarg;
+				break;
+			case 'm':
+				opts.mixed = 1;
+				break;
+			case 'o':
+				opts.spill = optarg;
+				break;
+			case 'O':
+				if (!strcmp(optarg, "nd"))
+					opts.order = ORDER_ND;
+				else if (!strcmp(optarg, "natural"))
+					opts.order = ORDER_NATURAL;
+				else
+				{
+					fprintf(stderr, "Unknown ordering: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'p':
+				if (!strcmp(optarg, "float"))
+					prec = PREC_FLOAT;
+				else if (!strcmp(optarg, "double"))
+					prec = PREC_DOUBLE;
+				else if (!strcmp(optarg, "ldouble"))
+					prec = PREC_LDOUBLE;
+				else
+				{
+					fprintf(stderr, "Unknown precision: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 't':
+				if ((opts.threads = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of threads should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'v':
+				opts.verify = 1;
+				break;
+			default:
+				usage = 1;
+		}
+	}
+
+	if (usage || ((opts.input || socket_path) && argc != optind) ||
+			(!opts.input && !socket_path && argc - optind != 1 && argc - optind != 2))
+	{
+		fprintf(stderr, "Usage: %s [-a row|tiled|spike|skyline|toeplitz] [-B systems] "
+				"[-f text|binary] [-m] [-o spill-file] "
+				"[-p float|double|ldouble] [-t threads] [-v] N [K]\t(N > 0, K > 0 right-hand sides)\n"
+				"       %s [-a row|skyline] [-f text|binary] [-O nd|natural] "
+				"[-p float|double|ldouble] [-t threads] "
+				"-i FILE\t(sparse SPD matrix, .mtx or binary CSR)\n"
+				"       %s [-t threads] -d SOCKET|-\t(serve solve requests, see daemon.h)\n",
+				argv[0], argv[0], argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if (socket_path)
+	{
+		if (opts.input || opts.batch > 0 || opts.mixed || opts.spill || opts.verify)
+		{
+			fprintf(stderr, "Daemon mode (-d) takes none of -B, -i, -m, -o and -v; "
+					"kernel and precision come with every request!\n");
+			return EXIT_SUCCESS;
+		}
+		if (opts.threads == 0)
+			opts.threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		memset(&state, 0, sizeof(state));
+		state.opts = &opts;
+		opt = daemon_serve(socket_path, serve_request, &state);
+		cholesky_server_destroy_f(state.f);
+		cholesky_server_destroy_d(state.d);
+		cholesky_server_destroy_ld(state.ld);
+		free(state.x);
+		return opt;
+	}
+
+	if (opts.input)
+	{
+		if (opts.batch > 0 || opts.mixed || opts.spill ||
+				(opts.alg != ALG_ROW && opts.alg != ALG_SKYLINE))
+		{
+			fprintf(stderr, "Sparse solves (-i) take none of -B, -m and -o, "
+					"and only the row or skyline kernels!\n");
+			return EXIT_SUCCESS;
+		}
+		if (opts.threads == 0)
+			opts.threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		printf("A = %s\n", opts.input);
+		switch (prec)
+		{
+			case PREC_FLOAT:
+				return cholesky_run_f(0, &opts);
+			case PREC_LDOUBLE:
+				return cholesky_run_ld(0, &opts);
+			default:
+				return cholesky_run_d(0, &opts);
+		}
+	}
+
+	if ((n = atoi(argv[optind])) <= 0)
+	{
+		fprintf(stderr, "Matrix size (N) should be positive!\n");
+		return EXIT_SUCCESS;
+	}
+	else
+		printf("N = %d\n", n);
+
+	if (argc - optind == 2 && (opts.k = atoi(argv[optind+1])) <= 0)
+	{
+		fprintf(stderr, "Number of right-hand sides (K) should be positive!\n");
+		return EXIT_SUCCESS;
+	}
+
+#ifdef OPTIMIZED
+	if (opts.alg == ALG_TILED)
+	{
+		fprintf(stderr, "The tiled kernel factors dense matrices; "
+				"use the non-OPTIMIZED build!\n");
+		return EXIT_SUCCESS;
+	}
+#else
+	if (opts.batch > 0 || opts.alg == ALG_SPIKE || opts.alg == ALG_TOEPLITZ || opts.spill)
+	{
+		fprintf(stderr, "Batched, partitioned, Toeplitz and out-of-core solves use band storage; "
+				"use the OPTIMIZED build!\n");
+		return EXIT_SUCCESS;
+	}
+#endif
+	if (opts.batch > 0 && (opts.mixed || opts.k > 1))
+	{
+		fprintf(stderr, "Batched solves (-B) take neither -m nor K!\n");
+		return EXIT_SUCCESS;
+	}
+	if (opts.spill && (opts.batch > 0 || opts.mixed || opts.k > 1 ||
+				opts.alg != ALG_ROW))
+	{
+		fprintf(stderr, "Out-of-core solves (-o) take none of -a, -B, -m and K!\n");
+		return EXIT_SUCCESS;
+	}
+	if ((opts.alg == ALG_SKYLINE || opts.alg == ALG_TOEPLITZ) &&
+			(opts.batch > 0 || opts.mixed || opts.k > 1))
+	{
+		fprintf(stderr, "Skyline and Toeplitz solves take none of -B, -m and K!\n");
+		return EXIT_SUCCESS;
+	}
+	if (opts.verify && (opts.batch > 0 || opts.spill || opts.mixed || opts.input ||
+				(opts.alg != ALG_ROW && opts.alg != ALG_TILED)))
+	{
+		fprintf(stderr, "Verification (-v) covers the row and tiled solves only!\n");
+		return EXIT_SUCCESS;
+	}
+	if (opts.mixed && (prec == PREC_FLOAT || opts.k > 1))
+	{
+		fprintf(stderr, "Mixed precision (-m) refines a single right-hand side "
+				"in double or long double!\n");
+		return EXIT_SUCCESS;
+	}
+	if (opts.threads == 0)
+		opts.threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+	switch (prec)
+	{
+		case PREC_FLOAT:
+			return cholesky_run_f(n, &opts);
+		case PREC_LDOUBLE:
+			return cholesky_run_ld(n, &opts);
+		default:
+			return cholesky_run_d(n, &opts);
+	}
+}
+
+
+/*
+ * Solves req with the state of its precision, which is created by the
+ * first request in that precision; see daemon.h.
+ */
+static void serve_request(const daemon_req_t *req, daemon_resp_t *resp,
+		const void **x, void *arg)
+{
+	daemon_state_t *st = (daemon_state_t *) arg;
+	server_stats_t stats;
+	size_t elem_size, size;
+	void *p;
+
+	switch (req->precision)
+	{
+		case PREC_FLOAT:
+			elem_size = sizeof(float);
+			break;
+		case PREC_DOUBLE:
+			elem_size = sizeof(double);
+			break;
+		case PREC_LDOUBLE:
+			elem_size = sizeof(long double);
+			break;
+		default:
+			resp->status = EINVAL;
+			return;
+	}
+	if (req->n == 0 || req->n > INT32_MAX)
+	{
+		resp->status = EINVAL;
+		return;
+	}
+	if ((size = req->n * elem_size) > st->x_size)
+	{
+		if (!(p = realloc(st->x, size)))
+		{
+			resp->status = ENOMEM;
+			return;
+		}
+		st->x = p;
+		st->x_size = size;
+	}
+
+	switch (req->precision)
+	{
+		case PREC_FLOAT:
+			if (!st->f && !(st->f = cholesky_server_create_f(st->opts)))
+				resp->status = ENOMEM;
+			else
+				resp->status = cholesky_server_solve_f(st->f, req->system, req->n,
+						(factor_alg) req->method, (float *) st->x, &stats);
+			break;
+		case PREC_LDOUBLE:
+			if (!st->ld && !(st->ld = cholesky_server_create_ld(st->opts)))
+				resp->status = ENOMEM;
+			else
+				resp->status = cholesky_server_solve_ld(st->ld, req->system, req->n,
+						(factor_alg) req->method, (long double *) st->x, &stats);
+			break;
+		default:
+			if (!st->d && !(st->d = cholesky_server_create_d(st->opts)))
+				resp->status = ENOMEM;
+			else
+				resp->status = cholesky_server_solve_d(st->d, req->system, req->n,
+						(factor_alg) req->method, (double *) st->x, &stats);
+	}
+	if (resp->status != 0)
+		return;
+
+	resp->n = req->n;
+	resp->elem_size = (uint32_t) elem_size;
+	resp->cached = (uint32_t) stats.cached;
+	resp->setup = stats.setup;
+	resp->solve = stats.solve;
+	*x = st->x;
+}
@@ -0,0 +1,142 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+/*
+ * bench: times the product by A2, the kernel of both methods, in every
+ * storage of A for every N given and prints one CSV line per (N, storage).
+ * Built for both variants, as bench and bench-optimal; "make benchmark"
+ * runs both into bench.csv.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "set2.h"
+
+#ifdef OPTIMIZED
+	#define VARIANT  "optimized"
+#else
+	#define VARIANT  "baseline"
+#endif
+
+static const char *storage_names[NUM_STORAGES] = {
+	"default", "dense", "stencil", "dia", "csr"
+};
+
+
+int main(int argc, char **argv)
+{
+	int i, k, n, opt, warmup = 2, reps = 10, header = 1, skip = 0, usage = 0;
+	char *prec = "double", *list, *name;
+	bench_result_t res;
+	int (*bench)(int, set2_storage, int, int, bench_result_t *) = set2_bench_d;
+
+	while ((opt = getopt(argc, argv, "Hp:r:s:w:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'H':
+				header = 0;
+				break;
+			case 'p':
+				prec = optarg;
+				if (!strcmp(optarg, "float"))
+					bench = set2_bench_f;
+				else if (!strcmp(optarg, "double"))
+					bench = set2_bench_d;
+				else if (!strcmp(optarg, "ldouble"))
+					bench = set2_bench_ld;
+				else
+				{
+					fprintf(stderr, "Unknown precision: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'r':
+				if ((reps = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of timed runs should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 's':
+				/* Storages left out, by name, e.g. -s dense */
+				for (list = optarg; (name = strtok(list, ",")); list = NULL)
+				{
+					for (k = STORE_DENSE; k < NUM_STORAGES; k++)
+						if (!strcmp(name, storage_names[k]))
+							break;
+					if (k == NUM_STORAGES)
+					{
+						fprintf(stderr, "Unknown storage: %s\n", name);
+						return EXIT_SUCCESS;
+					}
+					skip |= 1 << k;
+				}
+				break;
+			case 'w':
+				if ((warmup = atoi(optarg)) < 0)
+				{
+					fprintf(stderr, "Number of warm-up runs should not be negative!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			default:
+				usage = 1;
+		}
+	}
+
+	if (usage || optind >= argc)
+	{
+		fprintf(stderr, "Usage: %s [-H] [-p float|double|ldouble] [-r runs] "
+				"[-s dense,stencil,dia,csr] [-w warm-up runs] N...\t"
+				"(-H: no CSV header, -s: storages skipped)\n", argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if (header)
+		printf("variant,precision,storage,n,warmup,runs,median_s,p95_s,"
+				"flops,bytes,gflop_per_s,gbyte_per_s,bytes_per_flop\n");
+	for (i = optind; i < argc; i++)
+	{
+		if ((n = atoi(argv[i])) <= 0)
+		{
+			fprintf(stderr, "Matrix size (N) should be positive!\n");
+			return EXIT_FAILURE;
+		}
+		for (k = STORE_DENSE; k < NUM_STORAGES; k++)
+		{
+			if (skip & (1 << k))
+				continue;
+			if (bench(n, (set2_storage) k, warmup, reps, &res) != 0)
+				return EXIT_FAILURE;
+			printf("%s,%s,%s,%d,%d,%d,%.9f,%.9f,%.0f,%.0f,%.4f,%.4f,%.4f\n",
+					VARIANT, prec, storage_names[k], n, warmup, reps,
+					res.median, res.p95, res.flops, res.bytes,
+					res.flops / res.median * 1e-9,
+					res.bytes / res.median * 1e-9,
+					res.bytes / res.flops);
+			fflush(stdout);
+		}
+	}
+	return EXIT_SUCCESS;
+}
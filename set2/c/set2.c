@@ -26,105 +26,619 @@
 #include <setjmp.h>
 #include <errno.h>
 #include <math.h>
-
-#define BUFF_SIZE      16
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "set2.h"
+#include "csr.h"
+#include "trace.h"
+
+#define BUFF_SIZE      32
 #define NUM_METHODS    2
 #define MAX_ERROR      0.00005
+/*
+ * Iterations after which steepest_descent() gives up: it needs O(cond(A))
+ * of them, and cond(A1) grows as n^2 (229003 for n = 100)
+ */
+#define SD_MAX_ITER(n) ((n) < 4096 ? 100 * (n) * (n) : INT_MAX)
+/* Work vectors per method call (conjugate_gradients() needs the most) */
+#define MAX_WORK_VECS  8
+#define ALIGNMENT      64
+#define HUGE_PAGE_SIZE (2UL << 20)
+/* Elements per cache line; matrix rows are padded to a multiple of it */
+#define FPS_PER_LINE   (ALIGNMENT / sizeof(fptype))
+#define ROW_STRIDE(n)  (((size_t) (n) + FPS_PER_LINE - 1) / FPS_PER_LINE * FPS_PER_LINE)
+/* Bytes staged by the binary writer per write() */
+#define BIN_CHUNK      (1 << 20)
+/* Error message kept by a solver context */
+#define ERROR_SIZE     128
+/* A1 and A2: the diagonal of each, then the first and second off-diagonals of both */
+#define A1_DIAG        6
+#define A2_DIAG        7
+#define A_OFF1         (-4)
+#define A_OFF2         1
+/* Rows of A * p per block of the fused CG sweep */
+#define DIRECTION_BLOCK 512
+/* Diagonals a matrix may have to be stored in DIA */
+#define DIA_MAX_DIAGS  64
+#if defined(__AVX512F__)
+	#define VEC_BYTES  64
+#elif defined(__AVX__)
+	#define VEC_BYTES  32
+#else
+	#define VEC_BYTES  16
+#endif
+#define VEC_LANES      ((int) (sizeof(fpvec) / sizeof(fptype)))
 
 // #define  PRINT_INPUT_MATRICES
 #define  PRINT_RESULTS
 // #define  PRINT_TOFILE
+// #define  USE_HUGE_PAGES
 
-#if 1
-	#define FPTYPE_DOUBLE
+/*
+ * The precision is picked by the build: this file is compiled once for
+ * each of FPTYPE_FLOAT, FPTYPE_DOUBLE (default) and FPTYPE_LDOUBLE, and
+ * PREC_NAME() gives the exported symbols of every instance a suffix.
+ */
+#if defined(FPTYPE_FLOAT)
+	typedef float fptype;
+	#define PREC_SUFFIX    _f
+	#define FP_SQRT        sqrtf
+	#define FP_MANT_DIG    FLT_MANT_DIG
+	#define FP_EPSILON     FLT_EPSILON
+#elif defined(FPTYPE_LDOUBLE)
+	typedef long double fptype;
+	#define PREC_SUFFIX    _ld
+	#define FP_SQRT        sqrtl
+	#define FP_MANT_DIG    LDBL_MANT_DIG
+	#define FP_EPSILON     LDBL_EPSILON
+#else
+	#ifndef FPTYPE_DOUBLE
+		#define FPTYPE_DOUBLE
+	#endif
 	typedef double fptype;
+	#define PREC_SUFFIX    _d
+	#define FP_SQRT        sqrt
+	#define FP_MANT_DIG    DBL_MANT_DIG
+	#define FP_EPSILON     DBL_EPSILON
+#endif
+#if defined(FPTYPE_LDOUBLE) && LDBL_MANT_DIG == 64
+	/* x87 extended precision: the trailing bytes are padding */
+	#define FP_VALUE_BYTES 10
 #else
-	#undef FPTYPE_DOUBLE
-	typedef float fptype;
+	#define FP_VALUE_BYTES sizeof(fptype)
 #endif
+#define PREC_CAT(a, b)    a##b
+#define PREC_XCAT(a, b)   PREC_CAT(a, b)
+#define PREC_NAME(name)   PREC_XCAT(name, PREC_SUFFIX)
 
 typedef enum {S1=1, S2} sys_id;
 
+#ifdef FPTYPE_LDOUBLE
+	/* GCC has no long double vectors: the stencil runs on scalars */
+	typedef fptype fpvec;
+#else
+	/* SIMD vector of VEC_LANES fptype elements (GCC vector extension) */
+	typedef fptype fpvec __attribute__((vector_size(VEC_BYTES)));
+#endif
+
+/*
+ * Solver-scoped workspace: one aligned block is allocated per run and work
+ * vectors are carved out of it; arena_reset() hands them all back at once.
+ */
+typedef struct {
+	char   *base;
+	size_t  size;
+	size_t  used;
+} arena_t;
+
+typedef PREC_NAME(csr_matrix) csr_matrix_t;
+
+/*
+ * Diagonal (DIA) storage of a banded matrix: val[d * n + i] is
+ * A(i, i + off[d]) for the ndiag offsets in ascending order, and 0 where
+ * that column is outside A. Rows lo..hi-1 have all their diagonals inside.
+ */
+typedef struct {
+	int      n;
+	int      ndiag;
+	int     *off;
+	fptype  *val;
+	int      lo;
+	int      hi;
+} dia_t;
+
+/*
+ * Coefficient operator of a system, which the methods only apply: rows()
+ * computes rows lo..hi-1 of res = A * v, each of which reads v up to
+ * reach columns past its own. A is stored dense (op_dense()), in CSR
+ * (op_csr()) or DIA (op_dia()), or is A1 or A2 applied as a stencil
+ * (op_stencil()).
+ */
+typedef struct operator operator_t;
+
+struct operator {
+	int            n;
+	int            reach;
+	fptype       **dense;
+	csr_matrix_t  *csr;
+	dia_t         *dia;
+	void         (*rows)(operator_t *op, fptype *res, fptype *v, int lo, int hi);
+};
+
+/* System A{sid} * x = b{sid}; A is owned by op */
+typedef struct {
+	operator_t   op;
+	fptype      *b;
+} system_t;
+
+/*
+ * Solver context: the workspace of the methods, the error state of the
+ * running solve (the jump target of the vector kernels) and the stats of
+ * the last one. Nothing else is shared, so every thread solving with its
+ * own context is independent of the others.
+ */
+struct PREC_NAME(set2_ctx) {
+	arena_t       ws;
+	jmp_buf       env;
+	int           error;        /* Exit code of the last solve, 0 if none */
+	char          msg[ERROR_SIZE];
+	set2_stats_t  stats;
+};
+typedef PREC_NAME(set2_ctx) ctx_t;
+
+/*
+ * Daemon state (see daemon.h): a warm solver context and the systems
+ * generated last, so that a repeated request goes straight to the method.
+ * Full, the cache replaces its least recently used entry.
+ */
+#define SERVER_CACHE   4
+
+typedef struct {
+	sys_id          sid;        /* 0 if the entry is empty */
+	int             n;
+	system_t        sys;
+	unsigned long   used;       /* Request count at the last use */
+} server_entry_t;
+
+typedef struct PREC_NAME(set2_server) server_t;
+
+struct PREC_NAME(set2_server) {
+	ctx_t          *ctx;
+	server_entry_t  cache[SERVER_CACHE];
+	unsigned long   requests;
+};
+
+/*
+ * Job of set2_run_jobs(): one method on one system. The worker that runs
+ * it fills in the rest; x is a copy of the solution, or NULL.
+ */
+typedef struct {
+	int           n;
+	sys_id        sid;
+	set2_method   method;
+	operator_t   *a;
+	fptype       *b;
+	fptype       *x;
+	int           error;        /* Exit code of a failed solve */
+	char          msg[ERROR_SIZE];
+	set2_stats_t  stats;
+	double        wall;         /* Seconds, from pickup to completion */
+	double        cpu;          /* CPU seconds of the worker meanwhile */
+} job_t;
+
+/*
+ * Deque of the jobs (indices) a worker owns: the owner pops at the bottom,
+ * idle workers steal from the top, each end under the one lock.
+ */
+typedef struct {
+	pthread_mutex_t  lock;
+	int             *slot;
+	int              top;
+	int              bottom;
+} job_deque_t;
+
+/*
+ * Work-stealing scheduler: jobs are dealt out round-robin to the deques
+ * of the workers, which run their own and then steal from the others
+ * until none is left.
+ */
+typedef struct {
+	job_t        *jobs;
+	int           njobs;
+	job_deque_t  *deques;
+	int           nworkers;
+} job_sched_t;
+
+typedef struct {
+	job_sched_t  *sched;
+	int           id;
+	ctx_t        *ctx;
+} job_worker_t;
+
+/* Binary output file being written; see bin_open() */
+typedef struct {
+	int             fd;
+	size_t          used;       /* Bytes staged in buf */
+	unsigned char  *buf;
+} bin_writer_t;
+
 /* Function Prototypes */
-int       alloc_2d_matrices(int n, int num_args, ...);
-int       alloc_1d_matrices(int n, int num_args, ...);
-fptype  **alloc_2d_matrix(int n);
-fptype   *alloc_1d_matrix(int n);
-void      init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n);
-void      write_2d_matrix(char *filename, fptype **mat, int n);
-void      write_1d_matrix(char *filename, fptype *mat, int n);
-void      print_input_matrices(void);
-void      solve_system(fptype **a, fptype *b, int n, sys_id sid);
-fptype   *steepest_descent(fptype **A, fptype *b, fptype max_error, int n);
-fptype   *conjugate_gradients(fptype **A, fptype *b, fptype max_error, int n);
-fptype    euclidean_norm(fptype *v, int n);
-fptype    dot_product(fptype *v1, fptype *v2, int n);
-fptype   *matrix_vector_multiplication(fptype *res, fptype **mat, fptype *v,
-		int n);
-fptype   *scalar_vector_multiplication(fptype *res, fptype s, fptype *v, int n);
-fptype   *add_vectors(fptype *res, fptype *v1, fptype *v2, int n);
-fptype   *subtract_vectors(fptype *res, fptype *v1, fptype *v2, int n);
-void      free_1d_matrices(int num_args, ...);
-void      free_2d_matrices(int n, int num_args, ...);
-void      free_2d_matrix(fptype **mat, int n);
-
-/* Global data */
-fptype *(*methods[NUM_METHODS])(fptype **A, fptype *b, fptype max_error, int n) = {
+static int       alloc_1d_matrices(int n, int num_args, ...);
+static fptype  **alloc_2d_matrix(int n);
+static fptype   *alloc_1d_matrix(int n);
+static void     *alloc_aligned(size_t size);
+static int       arena_init(arena_t *arena, size_t size);
+static void     *arena_alloc(arena_t *arena, size_t size);
+static fptype   *arena_alloc_1d(arena_t *arena, int n);
+static size_t    arena_1d_size(int n);
+static void      arena_reset(arena_t *arena);
+static void      arena_destroy(arena_t *arena);
+static void      init_system(fptype **a, fptype *b, int n, sys_id sid);
+static int       system_create(system_t *sys, sys_id sid, int n, set2_storage storage);
+static void      system_destroy(system_t *sys);
+static csr_matrix_t *csr_band(int n, fptype diag);
+static dia_t    *dia_from_csr(csr_matrix_t *m);
+static void      dia_free(dia_t *a);
+static void      op_dense(operator_t *op, fptype **a, int n);
+static void      op_csr(operator_t *op, csr_matrix_t *a);
+static void      op_dia(operator_t *op, dia_t *a);
+static void      op_stencil(operator_t *op, sys_id sid, int n);
+static void      dense_rows(operator_t *op, fptype *res, fptype *v, int lo, int hi);
+static void      csr_rows(operator_t *op, fptype *res, fptype *v, int lo, int hi);
+static void      dia_rows(operator_t *op, fptype *res, fptype *v, int lo, int hi);
+static fptype    dia_row(dia_t *a, fptype *v, int i);
+static void      stencil_rows_a1(operator_t *op, fptype *res, fptype *v, int lo,
+			int hi);
+static void      stencil_rows_a2(operator_t *op, fptype *res, fptype *v, int lo,
+			int hi);
+static void      stencil_rows(fptype *res, fptype *v, int n, int lo, int hi,
+			fptype diag);
+static fptype    stencil_row(fptype *v, int i, int n, fptype diag);
+#ifdef OPTIMIZED
+static void      update_direction(fptype *p, fptype *r, fptype b_k, int lo, int hi);
+#endif
+#ifdef PRINT_INPUT_MATRICES
+static void      write_2d_matrix(char *filename, fptype **mat, int n, output_fmt fmt);
+#endif
+static void      write_1d_matrix(char *filename, fptype *mat, int n, output_fmt fmt);
+static void      write_binary(char *filename, fptype **mat, int rows, int n,
+			bin_layout layout);
+static int       bin_open(bin_writer_t *w, char *filename, bin_layout layout,
+			int rows, int n);
+static int       bin_write(bin_writer_t *w, fptype *x, size_t count, size_t stride);
+static int       bin_flush(bin_writer_t *w);
+static int       bin_close(bin_writer_t *w);
+#ifdef PRINT_INPUT_MATRICES
+static void      print_input_matrices(void);
+#endif
+static int       solve_input(ctx_t *ctx, set2_opts_t *opts);
+static void      print_system_header(sys_id sid);
+#ifdef PRINT_RESULTS
+static void      write_solution(fptype *x, int n, sys_id sid, set2_method method,
+			output_fmt out);
+#endif
+static int       run_jobs(job_t *jobs, int njobs, int nworkers);
+static void     *job_worker(void *arg);
+static int       job_next(job_sched_t *s, int id);
+static void      job_run(job_t *job, ctx_t *ctx);
+static void      job_print(job_t *job, output_fmt out);
+static double    thread_cpu_time(void);
+static void      solve_system(ctx_t *ctx, operator_t *a, fptype *b, int n, sys_id sid,
+			output_fmt out);
+static fptype   *solve(ctx_t *ctx, set2_method method, operator_t *a, fptype *b, int n,
+			fptype max_error);
+static void      set_error(ctx_t *ctx, int code, const char *msg);
+static fptype   *steepest_descent(ctx_t *ctx, operator_t *A, fptype *b, fptype max_error,
+			int n);
+static fptype   *conjugate_gradients(ctx_t *ctx, operator_t *A, fptype *b,
+			fptype max_error, int n);
+#ifdef OPTIMIZED
+static fptype    cg_direction(ctx_t *ctx, operator_t *A, fptype *p, fptype *Ap,
+			fptype *r, fptype b_k, int n);
+static fptype    cg_step(ctx_t *ctx, fptype *x, fptype *r, fptype *p, fptype *Ap,
+			fptype a_k, int n);
+#endif
+static fptype    euclidean_norm(ctx_t *ctx, fptype *v, int n);
+static fptype    dot_product(ctx_t *ctx, fptype *v1, fptype *v2, int n);
+static fptype   *matrix_vector_multiplication(ctx_t *ctx, fptype *res, operator_t *mat,
+			fptype *v, int n);
+static fptype   *scalar_vector_multiplication(ctx_t *ctx, fptype *res, fptype s,
+			fptype *v, int n);
+static fptype   *add_vectors(ctx_t *ctx, fptype *res, fptype *v1, fptype *v2, int n);
+static fptype   *subtract_vectors(ctx_t *ctx, fptype *res, fptype *v1, fptype *v2,
+			int n);
+static void      server_evict(server_entry_t *e);
+static void      bench_stats(bench_result_t *res, double *t, int reps);
+static int       bench_cmp(const void *a, const void *b);
+static double    wall_time(void);
+static void      free_1d_matrices(int num_args, ...);
+static void      free_2d_matrix(fptype **mat, int n);
+
+/* Read-only tables of the methods, indexed by set2_method */
+static fptype *(*const methods[NUM_METHODS])(ctx_t *ctx, operator_t *A, fptype *b,
+		fptype max_error, int n) = {
 	steepest_descent,
 	conjugate_gradients
 };
 
-char    *method_names[NUM_METHODS] = {"Steepest Descent", "Conjugate Gradient"};
-char    *method_initials[NUM_METHODS] = {"sd", "cg"};
-jmp_buf  j_error_env;
+static const char *const method_names[NUM_METHODS] = {"Steepest Descent", "Conjugate Gradient"};
+static const char *const method_initials[NUM_METHODS] = {"sd", "cg"};
 
 
-int main(int argc, char **argv)
+/*
+ * Solves A1 * x = b1 and A2 * x = b2, or the system of opts->input, with
+ * every method in this instance's precision; called by main() once the
+ * command line has been parsed.
+ */
+int PREC_NAME(set2_run)(int n, set2_opts_t *opts)
 {
-	int n;
-	fptype **a1  = NULL, **a2  = NULL,
-	        *b1  = NULL,  *b2  = NULL;
+	int ret;
+	system_t sys1, sys2;
+	ctx_t   *ctx;
 #ifdef PRINT_INPUT_MATRICES
 	char filename[BUFF_SIZE];
 #endif
 
-	if (argc != 2)
+	/* Workspace shared by all (system, method) runs */
+	if (!(ctx = PREC_NAME(set2_ctx_create)()))
+		return EXIT_FAILURE;
+
+	if (opts->input)
 	{
-		fprintf(stderr, "Usage: %s N\t(N > 0)\n", argv[0]);
-		return EXIT_SUCCESS;
+		ret = solve_input(ctx, opts);
+		PREC_NAME(set2_ctx_destroy)(ctx);
+		return ret;
 	}
 
-	if ((n = atoi(argv[1])) <= 0)
+	/* Initialize matrices */
+	if (system_create(&sys1, S1, n, opts->storage) != 0)
 	{
-		fprintf(stderr, "Matrix size (N) should be positive!\n");
-		return EXIT_SUCCESS;
+		PREC_NAME(set2_ctx_destroy)(ctx);
+		return EXIT_FAILURE;
 	}
-	else
-		printf("N = %d\n", n);
-
-	if (alloc_1d_matrices(n, 2, &b1, &b2) != 0 ||
-			alloc_2d_matrices(n, 2, &a1, &a2))
+	if (system_create(&sys2, S2, n, opts->storage) != 0)
+	{
+		system_destroy(&sys1);
+		PREC_NAME(set2_ctx_destroy)(ctx);
 		return EXIT_FAILURE;
-
-	/* Initialize matrices */
-	init_matrices(a1, a2, b1, b2, n);
+	}
 
 	/* Print a1, a2, b1 and b2 to files or stdout */
 #ifdef PRINT_INPUT_MATRICES
 	print_input_matrices();
 #endif
 
-	solve_system(a1, b1, n, S1);
-	solve_system(a2, b2, n, S2);
+	solve_system(ctx, &sys1.op, sys1.b, n, S1, opts->out);
+	solve_system(ctx, &sys2.op, sys2.b, n, S2, opts->out);
 
-	free_2d_matrices(n, 2, a1, a2);
-	free_1d_matrices(2, b1, b2);
+	PREC_NAME(set2_ctx_destroy)(ctx);
+	system_destroy(&sys1);
+	system_destroy(&sys2);
 
 	return EXIT_SUCCESS;
 }
 
 
-int alloc_1d_matrices(int n, int num_args, ...)
+/*
+ * Solves A1 * x = b1 and A2 * x = b2 of every order in sizes[0..count-1]
+ * with every method, as independent jobs run concurrently by opts->jobs
+ * workers. The results are printed in the order set2_run() would print
+ * them, each followed by the wall and CPU time of its job.
+ */
+int PREC_NAME(set2_run_jobs)(const int *sizes, int count, set2_opts_t *opts)
+{
+	int i, m, nsys = 0, njobs = 0, ret = EXIT_FAILURE;
+	system_t *sys;
+	job_t *jobs;
+	double t0, c0, elapsed;
+
+	sys = (system_t *) calloc(2 * count, sizeof(system_t));
+	jobs = (job_t *) calloc(2 * count * NUM_METHODS, sizeof(job_t));
+	if (!sys || !jobs)
+	{
+		perror("calloc");
+		goto out;
+	}
+
+	/* Systems are generated up front and only read by the jobs */
+	for (nsys = 0; nsys < 2 * count; nsys++)
+	{
+		if (system_create(&sys[nsys], (sys_id) (S1 + nsys % 2), sizes[nsys/2],
+					opts->storage) != 0)
+			goto out;
+		for (m = 0; m < NUM_METHODS; m++, njobs++)
+		{
+			jobs[njobs].n = sizes[nsys/2];
+			jobs[njobs].sid = (sys_id) (S1 + nsys % 2);
+			jobs[njobs].method = (set2_method) m;
+			jobs[njobs].a = &sys[nsys].op;
+			jobs[njobs].b = sys[nsys].b;
+		}
+	}
+
+	t0 = wall_time();
+	c0 = (double) clock() / CLOCKS_PER_SEC;
+	if (run_jobs(jobs, njobs, opts->jobs) != 0)
+		goto out;
+	elapsed = wall_time() - t0;
+
+	for (i = 0; i < njobs; i++)
+	{
+		if (i == 0 || jobs[i].n != jobs[i-1].n)
+			printf("%sN = %d\n", i ? "\n" : "", jobs[i].n);
+		if (i == 0 || jobs[i].n != jobs[i-1].n || jobs[i].sid != jobs[i-1].sid)
+			print_system_header(jobs[i].sid);
+		job_print(&jobs[i], opts->out);
+	}
+	printf("\n%d jobs on %d workers in %.6f s, CPU utilization %.1f%%\n",
+			njobs, opts->jobs, elapsed,
+			100.0 * ((double) clock() / CLOCKS_PER_SEC - c0) / (elapsed * opts->jobs));
+	ret = EXIT_SUCCESS;
+out:
+	for (i = 0; jobs && i < njobs; i++)
+		free(jobs[i].x);
+	for (i = 0; sys && i < nsys; i++)
+		system_destroy(&sys[i]);
+	free(jobs);
+	free(sys);
+	return ret;
+}
+
+
+/*
+ * Runs the jobs on nworkers threads, each with a solver context of its
+ * own, and returns once all of them are done.
+ */
+static int run_jobs(job_t *jobs, int njobs, int nworkers)
+{
+	int i, started, ret = EXIT_FAILURE;
+	job_sched_t s;
+	job_worker_t *w;
+	pthread_t *tids;
+
+	TRACE_SCOPE("run_jobs");
+
+	s.jobs = jobs;
+	s.njobs = njobs;
+	s.nworkers = nworkers;
+	s.deques = (job_deque_t *) calloc(nworkers, sizeof(job_deque_t));
+	w = (job_worker_t *) calloc(nworkers, sizeof(job_worker_t));
+	tids = (pthread_t *) malloc(nworkers * sizeof(pthread_t));
+	if (!s.deques || !w || !tids)
+	{
+		perror("malloc");
+		goto out;
+	}
+	for (i = 0; i < nworkers; i++)
+	{
+		if (!(s.deques[i].slot = (int *) malloc((njobs / nworkers + 1) * sizeof(int))) ||
+				!(w[i].ctx = PREC_NAME(set2_ctx_create)()))
+			goto out;
+		pthread_mutex_init(&s.deques[i].lock, NULL);
+		w[i].sched = &s;
+		w[i].id = i;
+	}
+	/* Dealt out round-robin; bottom is the end the owner pops from */
+	for (i = njobs - 1; i >= 0; i--)
+		s.deques[i % nworkers].slot[s.deques[i % nworkers].bottom++] = i;
+	for (started = 0; started < nworkers; started++)
+	{
+		if (pthread_create(&tids[started], NULL, job_worker, &w[started]) != 0)
+		{
+			perror("pthread_create");
+			break;
+		}
+	}
+	/* The workers started steal the jobs of those that did not */
+	if (started == 0)
+		job_worker(&w[0]);
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+	ret = EXIT_SUCCESS;
+
+	for (i = 0; i < nworkers; i++)
+		pthread_mutex_destroy(&s.deques[i].lock);
+out:
+	for (i = 0; w && s.deques && i < nworkers; i++)
+	{
+		PREC_NAME(set2_ctx_destroy)(w[i].ctx);
+		free(s.deques[i].slot);
+	}
+	free(tids);
+	free(w);
+	free(s.deques);
+	return ret;
+}
+
+
+static void *job_worker(void *arg)
+{
+	job_worker_t *w = (job_worker_t *) arg;
+	int j;
+
+	while ((j = job_next(w->sched, w->id)) >= 0)
+		job_run(&w->sched->jobs[j], w->ctx);
+	return NULL;
+}
+
+
+/*
+ * Next job of worker id: the newest of its own deque or, once that is
+ * empty, the oldest of the first other deque that is not; -1 if no job is
+ * left (jobs spawn no jobs, so none will be).
+ */
+static int job_next(job_sched_t *s, int id)
+{
+	int i, j = -1;
+	job_deque_t *d;
+
+	for (i = 0; i < s->nworkers && j < 0; i++)
+	{
+		d = &s->deques[(id + i) % s->nworkers];
+		pthread_mutex_lock(&d->lock);
+		if (d->top < d->bottom)
+			j = (i == 0) ? d->slot[--d->bottom] : d->slot[d->top++];
+		pthread_mutex_unlock(&d->lock);
+	}
+	return j;
+}
+
+
+static void job_run(job_t *job, ctx_t *ctx)
+{
+	fptype *x;
+	double t0, c0;
+
+	TRACE_SCOPE("job");
+
+	t0 = wall_time();
+	c0 = thread_cpu_time();
+	if ((x = solve(ctx, job->method, job->a, job->b, job->n, MAX_ERROR)) &&
+			(job->x = alloc_1d_matrix(job->n)))
+		memcpy(job->x, x, job->n * sizeof(fptype));
+	if (!x)
+	{
+		job->error = ctx->error;
+		memcpy(job->msg, ctx->msg, ERROR_SIZE);
+	}
+	else if (!job->x)
+	{
+		job->error = ENOMEM;
+		snprintf(job->msg, ERROR_SIZE, "cannot allocate the solution");
+	}
+	job->stats = ctx->stats;
+	job->cpu = thread_cpu_time() - c0;
+	job->wall = wall_time() - t0;
+}
+
+
+/* Prints job as solve_system() prints a method, and its times */
+static void job_print(job_t *job, output_fmt out)
+{
+	printf("\n# Method: %s\n", method_names[job->method]);
+	if (!job->x)
+	{
+		fprintf(stderr, "%s!\nAborting %s execution (exit code: %d)...\n",
+				job->msg, method_names[job->method], job->error);
+		return;
+	}
+	printf("\nk = %d\n", job->stats.iterations);
+	printf("Job time: %.6f s wall, %.6f s CPU (%.1f%%)\n", job->wall, job->cpu,
+			job->wall > 0 ? 100.0 * job->cpu / job->wall : 100.0);
+#ifdef PRINT_RESULTS
+	write_solution(job->x, job->n, job->sid, job->method, out);
+#endif
+}
+
+
+static int alloc_1d_matrices(int n, int num_args, ...)
 {
 	va_list args;
 	fptype ***ptr;
@@ -136,383 +650,1471 @@ int alloc_1d_matrices(int n, int num_args, ...)
 		return EXIT_FAILURE;
 	}
 
-	va_start(args, num_args);
-	for (i = 0; i < num_args; i++)
-	{
-		ptr[i] = va_arg(args, fptype **);
-		if (!(*ptr[i] = alloc_1d_matrix(n)))
-		{
-			for (j = 0; j < i; j++)
-				free(*ptr[j]);
-			free(ptr);
-			va_end(args);
-			return EXIT_FAILURE;
-		}
-	}
-	free(ptr);
-	va_end(args);
+	va_start(args, num_args);
+	for (i = 0; i < num_args; i++)
+	{
+		ptr[i] = va_arg(args, fptype **);
+		if (!(*ptr[i] = alloc_1d_matrix(n)))
+		{
+			for (j = 0; j < i; j++)
+				free(*ptr[j]);
+			free(ptr);
+			va_end(args);
+			return EXIT_FAILURE;
+		}
+	}
+	free(ptr);
+	va_end(args);
+	return EXIT_SUCCESS;
+}
+
+
+static fptype **alloc_2d_matrix(int n)
+{
+	int i;
+	size_t stride = ROW_STRIDE(n);
+	fptype **mat = (fptype **) malloc(n * sizeof(fptype *));
+
+	if (!mat)
+	{
+		perror("malloc");
+		return NULL;
+	}
+
+	/* All rows live in a single contiguous block */
+	mat[0] = (fptype *) alloc_aligned(n * stride * sizeof(fptype));
+	if (!mat[0])
+	{
+		free(mat);
+		return NULL;
+	}
+	for (i = 1; i < n; i++)
+		mat[i] = mat[i-1] + stride;
+	return mat;
+}
+
+
+static fptype *alloc_1d_matrix(int n)
+{
+	return (fptype *) alloc_aligned(n * sizeof(fptype));
+}
+
+
+/*
+ * Returns a zeroed block of (at least) size bytes that is aligned to
+ * ALIGNMENT bytes. If USE_HUGE_PAGES is defined, blocks spanning at least
+ * one huge page are aligned to HUGE_PAGE_SIZE and backed by transparent
+ * huge pages where the kernel supports it.
+ */
+static void *alloc_aligned(size_t size)
+{
+	void *ptr;
+	size_t alignment = ALIGNMENT;
+	int err;
+
+	size = (size + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+	if (size == 0)
+		size = ALIGNMENT;
+#ifdef USE_HUGE_PAGES
+	if (size >= HUGE_PAGE_SIZE)
+	{
+		alignment = HUGE_PAGE_SIZE;
+		size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	}
+#endif
+
+	if ((err = posix_memalign(&ptr, alignment, size)) != 0)
+	{
+		errno = err;
+		perror("posix_memalign");
+		return NULL;
+	}
+#if defined(USE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+	if (alignment == HUGE_PAGE_SIZE)
+		madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+
+static int arena_init(arena_t *arena, size_t size)
+{
+	arena->used = 0;
+	arena->size = (size + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+	if (!(arena->base = (char *) alloc_aligned(arena->size)))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+
+/* Returns a zeroed, ALIGNMENT-aligned chunk of the arena */
+static void *arena_alloc(arena_t *arena, size_t size)
+{
+	void *ptr;
+
+	size = (size + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+	if (size > arena->size - arena->used)
+	{
+		fprintf(stderr, "arena_alloc: workspace exhausted (%zu bytes "
+				"requested, %zu available)\n", size,
+				arena->size - arena->used);
+		return NULL;
+	}
+	ptr = arena->base + arena->used;
+	arena->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+
+static fptype *arena_alloc_1d(arena_t *arena, int n)
+{
+	return (fptype *) arena_alloc(arena, n * sizeof(fptype));
+}
+
+
+/* Arena bytes needed by arena_alloc_1d(arena, n) */
+static size_t arena_1d_size(int n)
+{
+	return (n * sizeof(fptype) + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1);
+}
+
+
+static void arena_reset(arena_t *arena)
+{
+	arena->used = 0;
+}
+
+
+static void arena_destroy(arena_t *arena)
+{
+	free(arena->base);
+	arena->base = NULL;
+	arena->size = arena->used = 0;
+}
+
+
+/* Fills b{sid} and, unless it is NULL, the dense A{sid}; both are zeroed */
+static void init_system(fptype **a, fptype *b, int n, sys_id sid)
+{
+	int i, j;
+
+	if (sid == S1)
+	{
+		b[0] = b[n-1] = 3;
+		b[1] = b[n-2] = -1;
+	}
+	else
+	{
+		b[0] = b[n-1] = 4;
+		for (i = 2; i < n-2; i++)
+			b[i] = 1;
+	}
+
+	for (i = 0; a && i < n; i++)
+	{
+		for (j = 0; j < n; j++)
+		{
+			if (i == j)
+				a[i][j] = (sid == S1) ? A1_DIAG : A2_DIAG;
+			else if (abs(i-j) == 1)
+				a[i][j] = A_OFF1;
+			else if (abs(i-j) == 2)
+				a[i][j] = A_OFF2;
+		}
+	}
+}
+
+
+/*
+ * System A{sid} * x = b{sid}, with A in storage: the stencil stores none
+ * of A, so only the vectors take memory; DIA and CSR store its band.
+ */
+static int system_create(system_t *sys, sys_id sid, int n, set2_storage storage)
+{
+	fptype **a = NULL;
+	csr_matrix_t *csr = NULL;
+	dia_t *dia;
+
+	if (storage == STORE_DEFAULT)
+#ifdef OPTIMIZED
+		storage = STORE_STENCIL;
+#else
+		storage = STORE_DENSE;
+#endif
+	if (!(sys->b = alloc_1d_matrix(n)))
+		return EXIT_FAILURE;
+	if ((storage == STORE_DENSE && !(a = alloc_2d_matrix(n))) ||
+			((storage == STORE_DIA || storage == STORE_CSR) &&
+			 !(csr = csr_band(n, (sid == S1) ? A1_DIAG : A2_DIAG))))
+	{
+		free(sys->b);
+		return EXIT_FAILURE;
+	}
+	init_system(a, sys->b, n, sid);
+
+	switch (storage)
+	{
+		case STORE_DENSE:
+			op_dense(&sys->op, a, n);
+			break;
+		case STORE_DIA:
+			dia = dia_from_csr(csr);
+			PREC_NAME(csr_free)(csr);
+			if (!dia)
+			{
+				free(sys->b);
+				return EXIT_FAILURE;
+			}
+			op_dia(&sys->op, dia);
+			break;
+		case STORE_CSR:
+			op_csr(&sys->op, csr);
+			break;
+		default:
+			op_stencil(&sys->op, sid, n);
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static void system_destroy(system_t *sys)
+{
+	free_2d_matrix(sys->op.dense, sys->op.n);
+	PREC_NAME(csr_free)(sys->op.csr);
+	dia_free(sys->op.dia);
+	free(sys->b);
+	sys->op.dense = NULL;
+	sys->op.csr = NULL;
+	sys->op.dia = NULL;
+	sys->b = NULL;
+}
+
+
+/* Pentadiagonal A1 or A2 (of diagonal diag) in CSR */
+static csr_matrix_t *csr_band(int n, fptype diag)
+{
+	int i, j;
+	int64_t p = 0;
+	csr_matrix_t *m;
+
+	if (!(m = (csr_matrix_t *) calloc(1, sizeof(csr_matrix_t))))
+	{
+		perror("calloc");
+		return NULL;
+	}
+	m->n = n;
+	m->owns = 3;
+	m->row_ptr = (int64_t *) malloc((n + 1) * sizeof(int64_t));
+	m->col = (int32_t *) malloc(5 * (size_t) n * sizeof(int32_t));
+	m->val = (fptype *) malloc(5 * (size_t) n * sizeof(fptype));
+	if (!m->row_ptr || !m->col || !m->val)
+	{
+		perror("malloc");
+		PREC_NAME(csr_free)(m);
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		m->row_ptr[i] = p;
+		for (j = (i >= 2) ? i-2 : 0; j <= i+2 && j < n; j++, p++)
+		{
+			m->col[p] = j;
+			if (i == j)
+				m->val[p] = diag;
+			else
+				m->val[p] = (abs(i-j) == 1) ? A_OFF1 : A_OFF2;
+		}
+	}
+	m->row_ptr[n] = m->nnz = p;
+	return m;
+}
+
+
+/*
+ * A of CSR in DIA storage, or NULL if A has more than DIA_MAX_DIAGS
+ * diagonals with nonzeros: DIA stores every one of them over all n rows.
+ * Duplicate entries are added up, as in a product.
+ */
+static dia_t *dia_from_csr(csr_matrix_t *m)
+{
+	int i, k, d = 0, n = m->n, *slot;
+	int64_t p;
+	dia_t *a;
+
+	/* slot[n-1 + off] is the index of diagonal off, or -1 */
+	if (!(slot = (int *) malloc((2 * (size_t) n - 1) * sizeof(int))))
+	{
+		perror("malloc");
+		return NULL;
+	}
+	for (k = 0; k < 2*n - 1; k++)
+		slot[k] = -1;
+	for (i = 0; i < n; i++)
+		for (p = m->row_ptr[i]; p < m->row_ptr[i+1]; p++)
+			if (slot[n-1 + m->col[p] - i] == -1)
+			{
+				slot[n-1 + m->col[p] - i] = 0;
+				d++;
+			}
+	if (d > DIA_MAX_DIAGS)
+	{
+		fprintf(stderr, "A has more than %d diagonals, too many for DIA storage\n",
+				DIA_MAX_DIAGS);
+		free(slot);
+		return NULL;
+	}
+
+	if (!(a = (dia_t *) calloc(1, sizeof(dia_t))))
+	{
+		perror("calloc");
+		free(slot);
+		return NULL;
+	}
+	a->n = n;
+	a->ndiag = d;
+	a->off = (int *) malloc((d + 1) * sizeof(int));
+	a->val = (fptype *) alloc_aligned((size_t) d * n * sizeof(fptype));
+	if (!a->off || (d && !a->val))
+	{
+		if (!a->off)
+			perror("malloc");
+		free(slot);
+		dia_free(a);
+		return NULL;
+	}
+	for (k = 0, d = 0; k < 2*n - 1; k++)
+		if (slot[k] == 0)
+		{
+			a->off[d] = k - (n-1);
+			slot[k] = d++;
+		}
+	for (i = 0; i < n; i++)
+		for (p = m->row_ptr[i]; p < m->row_ptr[i+1]; p++)
+			a->val[(size_t) slot[n-1 + m->col[p] - i] * n + i] += m->val[p];
+	free(slot);
+
+	a->lo = (d && a->off[0] < 0) ? -a->off[0] : 0;
+	a->hi = (d && a->off[d-1] > 0) ? n - a->off[d-1] : n;
+	if (a->hi < a->lo)
+		a->hi = a->lo;
+	return a;
+}
+
+
+static void dia_free(dia_t *a)
+{
+	if (!a)
+		return;
+	free(a->off);
+	free(a->val);
+	free(a);
+}
+
+
+/* Operator of the dense n x n matrix a (of which OPTIMIZED reads the band) */
+static void op_dense(operator_t *op, fptype **a, int n)
+{
+	op->n = n;
+#ifdef OPTIMIZED
+	op->reach = 2;
+#else
+	op->reach = n;
+#endif
+	op->dense = a;
+	op->csr = NULL;
+	op->dia = NULL;
+	op->rows = dense_rows;
+}
+
+
+/*
+ * The reach of a CSR operator is that of its farthest nonzero, searched
+ * over every entry so that rows need not be sorted
+ */
+static void op_csr(operator_t *op, csr_matrix_t *a)
+{
+	int i;
+	int64_t p;
+
+	op->n = a->n;
+	op->reach = 0;
+	for (i = 0; i < a->n; i++)
+		for (p = a->row_ptr[i]; p < a->row_ptr[i+1]; p++)
+			if (a->col[p] - i > op->reach)
+				op->reach = a->col[p] - i;
+	op->dense = NULL;
+	op->csr = a;
+	op->dia = NULL;
+	op->rows = csr_rows;
+}
+
+
+static void op_dia(operator_t *op, dia_t *a)
+{
+	op->n = a->n;
+	op->reach = (a->ndiag && a->off[a->ndiag-1] > 0) ? a->off[a->ndiag-1] : 0;
+	op->dense = NULL;
+	op->csr = NULL;
+	op->dia = a;
+	op->rows = dia_rows;
+}
+
+
+static void dense_rows(operator_t *op, fptype *res, fptype *v, int lo, int hi)
+{
+	int i, j, lb, ub, n = op->n;
+
+	for (i = lo; i < hi; i++)
+	{
+#ifdef OPTIMIZED
+		lb = (i >= 2)   ? i-2 : 0;
+		ub = (i <= n-3) ? i+2 : n-1;
+#else
+		lb = 0;
+		ub = n-1;
+#endif
+		for (j = lb, res[i] = 0.0; j <= ub; j++)
+			res[i] += op->dense[i][j] * v[j];
+	}
+}
+
+
+/*
+ * The OPTIMIZED build sums the nonzeros of a row VEC_LANES at a time,
+ * gathering their elements of v, into as many partial sums; these are
+ * added up in lane order, followed by the rest of the row.
+ */
+static void csr_rows(operator_t *op, fptype *res, fptype *v, int lo, int hi)
+{
+	int i;
+	int64_t p, end;
+	fptype sum;
+	csr_matrix_t *m = op->csr;
+#ifdef OPTIMIZED
+	int l;
+	fptype lane[VEC_LANES];
+	fpvec s, t, x;
+#endif
+
+	for (i = lo; i < hi; i++)
+	{
+		p = m->row_ptr[i];
+		end = m->row_ptr[i+1];
+		sum = 0.0;
+#ifdef OPTIMIZED
+		if (end - p >= VEC_LANES)
+		{
+			memset(&s, 0, sizeof(fpvec));
+			for (; p + VEC_LANES <= end; p += VEC_LANES)
+			{
+				for (l = 0; l < VEC_LANES; l++)
+					lane[l] = v[m->col[p+l]];
+				memcpy(&x, lane, sizeof(fpvec));
+				memcpy(&t, m->val + p, sizeof(fpvec));
+				s += t * x;
+			}
+			memcpy(lane, &s, sizeof(fpvec));
+			for (l = 0; l < VEC_LANES; l++)
+				sum += lane[l];
+		}
+#endif
+		for (; p < end; p++)
+			sum += m->val[p] * v[m->col[p]];
+		res[i] = sum;
+	}
+}
+
+
+/*
+ * Rows a->lo..a->hi-1 read all their diagonals and are computed VEC_LANES
+ * at a time, with contiguous loads of every diagonal and of v; the rows
+ * before and after them one by one. Every row sums its terms by ascending
+ * column, as dense_rows() does.
+ */
+static void dia_rows(operator_t *op, fptype *res, fptype *v, int lo, int hi)
+{
+	int i = lo, d;
+	dia_t *a = op->dia;
+	fpvec s, t, x;
+
+	for (; i < hi && i < a->lo; i++)
+		res[i] = dia_row(a, v, i);
+	for (; i + VEC_LANES <= hi && i + VEC_LANES <= a->hi; i += VEC_LANES)
+	{
+		memset(&s, 0, sizeof(fpvec));
+		for (d = 0; d < a->ndiag; d++)
+		{
+			memcpy(&t, a->val + (size_t) d * a->n + i, sizeof(fpvec));
+			memcpy(&x, v + i + a->off[d], sizeof(fpvec));
+			s += t * x;
+		}
+		memcpy(res + i, &s, sizeof(fpvec));
+	}
+	for (; i < hi; i++)
+		res[i] = dia_row(a, v, i);
+}
+
+
+static fptype dia_row(dia_t *a, fptype *v, int i)
+{
+	int d, j;
+	fptype sum = 0.0;
+
+	for (d = 0; d < a->ndiag; d++)
+		if ((j = i + a->off[d]) >= 0 && j < a->n)
+			sum += a->val[(size_t) d * a->n + i] * v[j];
+	return sum;
+}
+
+
+/*
+ * Operator of A{sid} with its coefficients built in: a product streams v
+ * and res only. Rows 0, 1, n-2 and n-1 miss part of the band and are
+ * computed one by one, the rows in between VEC_LANES at a time; every row
+ * sums its terms in the order of dense_rows(), so the results are the
+ * same.
+ */
+static void op_stencil(operator_t *op, sys_id sid, int n)
+{
+	op->n = n;
+	op->reach = 2;
+	op->dense = NULL;
+	op->csr = NULL;
+	op->dia = NULL;
+	op->rows = (sid == S1) ? stencil_rows_a1 : stencil_rows_a2;
+}
+
+
+static void stencil_rows_a1(operator_t *op, fptype *res, fptype *v, int lo, int hi)
+{
+	stencil_rows(res, v, op->n, lo, hi, A1_DIAG);
+}
+
+
+static void stencil_rows_a2(operator_t *op, fptype *res, fptype *v, int lo, int hi)
+{
+	stencil_rows(res, v, op->n, lo, hi, A2_DIAG);
+}
+
+
+/* Rows lo..hi-1 of res = A * v, for A of diagonal diag */
+static void stencil_rows(fptype *res, fptype *v, int n, int lo, int hi, fptype diag)
+{
+	int i = lo;
+	fpvec s, t;
+
+	for (; i < hi && i < 2; i++)
+		res[i] = stencil_row(v, i, n, diag);
+	for (; i + VEC_LANES <= hi && i + VEC_LANES <= n-2; i += VEC_LANES)
+	{
+		memcpy(&t, v + i-2, sizeof(fpvec));
+		s = t * (fptype) A_OFF2;
+		memcpy(&t, v + i-1, sizeof(fpvec));
+		s += t * (fptype) A_OFF1;
+		memcpy(&t, v + i, sizeof(fpvec));
+		s += t * diag;
+		memcpy(&t, v + i+1, sizeof(fpvec));
+		s += t * (fptype) A_OFF1;
+		memcpy(&t, v + i+2, sizeof(fpvec));
+		s += t * (fptype) A_OFF2;
+		memcpy(res + i, &s, sizeof(fpvec));
+	}
+	for (; i < hi; i++)
+		res[i] = stencil_row(v, i, n, diag);
+}
+
+
+static fptype stencil_row(fptype *v, int i, int n, fptype diag)
+{
+	fptype sum = 0.0;
+
+	if (i >= 2)
+		sum += v[i-2] * (fptype) A_OFF2;
+	if (i >= 1)
+		sum += v[i-1] * (fptype) A_OFF1;
+	sum += v[i] * diag;
+	if (i+1 < n)
+		sum += v[i+1] * (fptype) A_OFF1;
+	if (i+2 < n)
+		sum += v[i+2] * (fptype) A_OFF2;
+	return sum;
+}
+
+
+#ifdef PRINT_INPUT_MATRICES
+static void write_2d_matrix(char *filename, fptype **mat, int n, output_fmt fmt)
+{
+	int i, j;
+	FILE *outfile;
+
+	if (fmt == OUT_BINARY)
+	{
+		write_binary(filename, mat, n, n, BIN_DENSE);
+		return;
+	}
+
+#ifdef PRINT_TOFILE
+	outfile = fopen(filename, "w");
+	if (!outfile)
+	{
+		perror("fopen");
+		return;
+	}
+#else
+	outfile = stdout;
+#endif
+
+	for (i = 0; i < n; i++)
+	{
+		for (j = 0; j < n; j++)
+			fprintf(outfile, "%8.4f  ", (double) mat[i][j]);
+		fprintf(outfile, "\n");
+	}
+
+#ifdef PRINT_TOFILE
+	fclose(outfile);
+#endif
+}
+#endif
+
+
+static void write_1d_matrix(char *filename, fptype *mat, int n, output_fmt fmt)
+{
+	int i;
+	FILE *outfile;
+
+	if (fmt == OUT_BINARY)
+	{
+		write_binary(filename, &mat, 1, n, BIN_VECTOR);
+		return;
+	}
+
+#ifdef PRINT_TOFILE
+	outfile = fopen(filename, "w");
+	if (!outfile)
+	{
+		perror("fopen");
+		return;
+	}
+#else
+	outfile = stdout;
+#endif
+
+	for (i = 0; i < n; i++)
+		fprintf(outfile, "%8.4f\n", (double) mat[i]);
+
+#ifdef PRINT_TOFILE
+	fclose(outfile);
+#endif
+}
+
+
+/*
+ * Binary counterpart of write_1d_matrix() and write_2d_matrix(): the rows
+ * rows of mat go to filename with its extension replaced by BIN_EXT, in
+ * the format of binfmt.h.
+ */
+static void write_binary(char *filename, fptype **mat, int rows, int n, bin_layout layout)
+{
+	int i;
+	bin_writer_t w;
+
+	if (bin_open(&w, filename, layout, rows, n) != 0)
+		return;
+	for (i = 0; i < rows; i++)
+		if (bin_write(&w, mat[i], n, 1) != 0)
+			break;
+	bin_close(&w);
+}
+
+
+static int bin_open(bin_writer_t *w, char *filename, bin_layout layout, int rows, int n)
+{
+	char path[BUFF_SIZE + sizeof(BIN_EXT)], *dot;
+	bin_hdr_t hdr;
+
+	/* x1_10.txt is written as x1_10.bin */
+	snprintf(path, BUFF_SIZE, "%s", filename);
+	if ((dot = strrchr(path, '.')))
+		*dot = '\0';
+	strcat(path, BIN_EXT);
+
+	if (!(w->buf = (unsigned char *) alloc_aligned(BIN_CHUNK)))
+		return EXIT_FAILURE;
+	if ((w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		perror("open");
+		free(w->buf);
+		return EXIT_FAILURE;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version   = htole32(BIN_VERSION);
+	hdr.elem_size = htole32(sizeof(fptype));
+	hdr.mant_dig  = htole32(FP_MANT_DIG);
+	hdr.layout    = htole32(layout);
+	hdr.rows      = htole64(rows);
+	hdr.n         = htole64(n);
+	memcpy(w->buf, &hdr, sizeof(hdr));
+	w->used = BIN_HDR_SIZE;
+	return EXIT_SUCCESS;
+}
+
+
+/* Appends count elements, x[0], x[stride], x[2*stride] and so on */
+static int bin_write(bin_writer_t *w, fptype *x, size_t count, size_t stride)
+{
+	size_t i, m;
+	unsigned char *p;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	size_t j;
+	unsigned char c;
+#endif
+
+	while (count > 0)
+	{
+		if (w->used == BIN_CHUNK && bin_flush(w) != 0)
+			return EXIT_FAILURE;
+		m = (BIN_CHUNK - w->used) / sizeof(fptype);
+		if (m > count)
+			m = count;
+		p = w->buf + w->used;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (stride == 1 && FP_VALUE_BYTES == sizeof(fptype))
+			memcpy(p, x, m * sizeof(fptype));
+		else
+#endif
+		{
+			for (i = 0; i < m; i++, p += sizeof(fptype))
+			{
+				memset(p, 0, sizeof(fptype));
+				memcpy(p, &x[i*stride], FP_VALUE_BYTES);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				for (j = 0; j < sizeof(fptype) / 2; j++)
+				{
+					c = p[j];
+					p[j] = p[sizeof(fptype)-1-j];
+					p[sizeof(fptype)-1-j] = c;
+				}
+#endif
+			}
+		}
+		w->used += m * sizeof(fptype);
+		x += m * stride;
+		count -= m;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int bin_flush(bin_writer_t *w)
+{
+	unsigned char *p = w->buf;
+	ssize_t ret;
+
+	while (w->used > 0)
+	{
+		if ((ret = write(w->fd, p, w->used)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return EXIT_FAILURE;
+		}
+		p += ret;
+		w->used -= ret;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int bin_close(bin_writer_t *w)
+{
+	int ret = bin_flush(w);
+
+	if (close(w->fd) != 0)
+	{
+		perror("close");
+		ret = EXIT_FAILURE;
+	}
+	free(w->buf);
+	return ret;
+}
+
+#ifdef PRINT_INPUT_MATRICES
+static void print_input_matrices(void)
+{
+	#ifndef PRINT_TOFILE
+	printf("\nWriting A1...\n");
+	#endif
+	snprintf(filename, BUFF_SIZE, "a1_%d.txt", n);
+	write_2d_matrix(filename, a1, n, out);
+	#ifndef PRINT_TOFILE
+	printf("\nWriting A2...\n");
+	#endif
+	snprintf(filename, BUFF_SIZE, "a2_%d.txt", n);
+	write_2d_matrix(filename, a2, n, out);
+	#ifndef PRINT_TOFILE
+	printf("\nWriting B1...\n");
+	#endif
+	snprintf(filename, BUFF_SIZE, "b1_%d.txt", n);
+	write_1d_matrix(filename, b1, n, out);
+	#ifndef PRINT_TOFILE
+	printf("\nWriting B2...\n");
+	#endif
+	snprintf(filename, BUFF_SIZE, "b2_%d.txt", n);
+	write_1d_matrix(filename, b2, n, out);
+}
+#endif
+
+
+/*
+ * Solves A * x = b for the sparse matrix A of opts->input, with b the row
+ * sums of A so that x is all ones; A is applied in CSR, or in DIA if
+ * opts->storage asks for it.
+ */
+static int solve_input(ctx_t *ctx, set2_opts_t *opts)
+{
+	int i, n, ret = EXIT_FAILURE;
+	fptype *b = NULL, *ones = NULL;
+	csr_matrix_t *csr;
+	dia_t *dia = NULL;
+	operator_t a;
+
+	TRACE_SCOPE("solve_input");
+
+	if (!(csr = PREC_NAME(csr_load)(opts->input, opts->threads)))
+		return EXIT_FAILURE;
+	n = csr->n;
+	printf("N = %d, nnz(A) = %lld\n", n, (long long) csr->nnz);
+	if (opts->storage == STORE_DIA)
+	{
+		if (!(dia = dia_from_csr(csr)))
+			goto out;
+		op_dia(&a, dia);
+	}
+	else
+		op_csr(&a, csr);
+
+	if (alloc_1d_matrices(n, 2, &b, &ones) != 0)
+		goto out;
+	for (i = 0; i < n; i++)
+		ones[i] = 1;
+	PREC_NAME(csr_matvec)(csr, ones, b);
+
+	solve_system(ctx, &a, b, n, S1, opts->out);
+
+	free_1d_matrices(2, b, ones);
+	ret = EXIT_SUCCESS;
+out:
+	dia_free(dia);
+	PREC_NAME(csr_free)(csr);
+	return ret;
+}
+
+
+static void solve_system(ctx_t *ctx, operator_t *a, fptype *b, int n, sys_id sid,
+		output_fmt out)
+{
+	int i;
+	fptype *x;
+
+	TRACE_SCOPE("solve_system");
+
+	print_system_header(sid);
+	for (i = 0; i < NUM_METHODS; i++)
+	{
+		printf("\n# Method: %s\n", method_names[i]);
+		if (!(x = solve(ctx, (set2_method) i, a, b, n, MAX_ERROR)))
+		{
+			fprintf(stderr, "%s!\nAborting %s execution (exit code: %d)...\n",
+					ctx->msg, method_names[i], ctx->error);
+			continue;
+		}
+		printf("\nk = %d\n", ctx->stats.iterations);
+#ifdef PRINT_RESULTS
+		write_solution(x, n, sid, (set2_method) i, out);
+#endif
+	}
+}
+
+
+static void print_system_header(sys_id sid)
+{
+	printf("\n######################\n");
+	printf("# System: No.%1d       #\n", sid);
+	printf("######################\n");
+}
+
+
+#ifdef PRINT_RESULTS
+static void write_solution(fptype *x, int n, sys_id sid, set2_method method,
+		output_fmt out)
+{
+	char filename[BUFF_SIZE];
+
+#ifndef PRINT_TOFILE
+	printf("\nWriting X%d...\n", sid);
+#endif
+	snprintf(filename, BUFF_SIZE, "x%1d_%d_%2s.txt", sid, n, method_initials[method]);
+	write_1d_matrix(filename, x, n, out);
+}
+#endif
+
+/*
+ * Runs method on A * x = b with the workspace of ctx, which grows to n if
+ * needed, and records its stats; x is drawn from the workspace and stays
+ * valid until the next solve. Returns NULL with ctx->error and ctx->msg
+ * set on failure.
+ */
+static fptype *solve(ctx_t *ctx, set2_method method, operator_t *a, fptype *b, int n,
+		fptype max_error)
+{
+	fptype *x;
+	double t0;
+
+	ctx->error = 0;
+	ctx->msg[0] = '\0';
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	if ((int) method < 0 || (int) method >= NUM_METHODS || n <= 0)
+	{
+		set_error(ctx, EINVAL, "invalid method or matrix size");
+		return NULL;
+	}
+	if (ctx->ws.size < MAX_WORK_VECS * arena_1d_size(n))
+	{
+		arena_destroy(&ctx->ws);
+		if (arena_init(&ctx->ws, MAX_WORK_VECS * arena_1d_size(n)) != 0)
+		{
+			set_error(ctx, ENOMEM, "cannot allocate the workspace");
+			return NULL;
+		}
+	}
+	/* Every method draws its work vectors (and x) from the workspace */
+	arena_reset(&ctx->ws);
+
+	t0 = wall_time();
+	x = (methods[method])(ctx, a, b, max_error, n);
+	ctx->stats.seconds = wall_time() - t0;
+	return x;
+}
+
+
+static void set_error(ctx_t *ctx, int code, const char *msg)
+{
+	ctx->error = code;
+	snprintf(ctx->msg, ERROR_SIZE, "%s", msg);
+}
+
+
+ctx_t *PREC_NAME(set2_ctx_create)(void)
+{
+	ctx_t *ctx;
+
+	if (!(ctx = (ctx_t *) calloc(1, sizeof(ctx_t))))
+		perror("calloc");
+	return ctx;
+}
+
+
+void PREC_NAME(set2_ctx_destroy)(ctx_t *ctx)
+{
+	if (!ctx)
+		return;
+	arena_destroy(&ctx->ws);
+	free(ctx);
+}
+
+
+/*
+ * Library entry points: solve A * x = b with method into the caller's x,
+ * for A given by the row pointers of a dense matrix (only its band is read
+ * by the OPTIMIZED build) or in CSR.
+ */
+int PREC_NAME(set2_solve_dense)(ctx_t *ctx, set2_method method, fptype **a, fptype *b,
+		int n, fptype tol, fptype *x)
+{
+	operator_t op;
+	fptype *res;
+
+	op_dense(&op, a, n);
+	if (!(res = solve(ctx, method, &op, b, n, tol)))
+		return EXIT_FAILURE;
+	memcpy(x, res, n * sizeof(fptype));
 	return EXIT_SUCCESS;
 }
 
 
-int alloc_2d_matrices(int n, int num_args, ...)
+int PREC_NAME(set2_solve_csr)(ctx_t *ctx, set2_method method, csr_matrix_t *a,
+		fptype *b, fptype tol, fptype *x)
 {
-	va_list args;
-	fptype ****ptr;
-	int i, j;
+	operator_t op;
+	fptype *res;
 
-	if (!(ptr = (fptype ****) malloc(num_args * sizeof(fptype ***))))
-	{
-		perror("malloc");
+	op_csr(&op, a);
+	if (!(res = solve(ctx, method, &op, b, a->n, tol)))
 		return EXIT_FAILURE;
-	}
-
-	va_start(args, num_args);
-	for (i = 0; i < num_args; i++)
-	{
-		ptr[i] = va_arg(args, fptype ***);
-		if (!(*ptr[i] = alloc_2d_matrix(n)))
-		{
-			for (j = 0; j < i; j++)
-				free_2d_matrix(*ptr[j], n);
-			free(ptr);
-			va_end(args);
-			return EXIT_FAILURE;
-		}
-	}
-	free(ptr);
-	va_end(args);
+	memcpy(x, res, a->n * sizeof(fptype));
 	return EXIT_SUCCESS;
 }
 
 
-fptype **alloc_2d_matrix(int n)
+const set2_stats_t *PREC_NAME(set2_ctx_stats)(ctx_t *ctx)
 {
-	int i, j;
-	fptype **mat = (fptype **) malloc(n * sizeof(fptype *));
+	return &ctx->stats;
+}
 
-	if (!mat)
-	{
-		perror("malloc");
-		return NULL;
-	}
 
-	for (i = 0; i < n; i++)
-	{
-		mat[i] = (fptype *) calloc(n, sizeof(fptype));
-		if (!mat[i])
-		{
-			perror("calloc");
-			for (j = 0; j < i; j++)
-				free(mat[j]);
-			free(mat);
-			return NULL;
-		}
-	}
-	return mat;
+/* Message of the error that ended the last solve, or "" */
+const char *PREC_NAME(set2_ctx_error)(ctx_t *ctx)
+{
+	return ctx->msg;
 }
 
 
-fptype *alloc_1d_matrix(int n)
+/* Daemon state: a solver context of its own and an empty cache */
+server_t *PREC_NAME(set2_server_create)(void)
 {
-	fptype *mat = (fptype *) calloc(n, sizeof(fptype));
+	server_t *s;
 
-	if (!mat)
+	if (!(s = (server_t *) calloc(1, sizeof(server_t))))
 	{
 		perror("calloc");
 		return NULL;
 	}
-
-	return mat;
+	if (!(s->ctx = PREC_NAME(set2_ctx_create)()))
+	{
+		free(s);
+		return NULL;
+	}
+	return s;
 }
 
 
-void init_matrices(fptype **a1, fptype **a2, fptype *b1, fptype *b2, int n)
+/*
+ * Solves A{sid} * x = b{sid} of order n with method, generating the system
+ * only if it is not cached; tol <= 0 stands for the default of set2_run().
+ * Returns 0, EINVAL for an invalid request (a tol below the rounding error
+ * of b included), ENOMEM if the system cannot be generated, or the exit
+ * code of a failed solve (ETIMEDOUT if steepest_descent() did not converge).
+ */
+int PREC_NAME(set2_server_solve)(server_t *s, int sid, int n, set2_method method,
+		fptype tol, fptype *x, server_stats_t *st)
 {
-	int i, j;
-
-	/* Init b1 */
-	b1[0] = b1[n-1] = 3;
-	b1[1] = b1[n-2] = -1;
-
-	/* Init b2 */
-	b2[0] = b2[n-1] = 4;
-	for (i = 2; i < n-2; i++)
-		b2[i] = 1;
-
-	/* Init a1, a2 */
-	for (i = 0; i < n; i++)
+	int i;
+	double t0;
+	fptype *res;
+	server_entry_t *e = NULL;
+
+	if ((sid != S1 && sid != S2) || n < 3 ||
+			(int) method < 0 || (int) method >= NUM_METHODS)
+		return EINVAL;
+
+	s->requests++;
+	st->cached = 0;
+	st->setup = 0;
+	for (i = 0; i < SERVER_CACHE; i++)
 	{
-		for (j = 0; j < n; j++)
+		if (s->cache[i].sid == (sys_id) sid && s->cache[i].n == n)
 		{
-			if (i == j)
-			{
-				a1[i][j] = 6;
-				a2[i][j] = 7;
-			}
-			else if (abs(i-j) == 1)
-				a1[i][j] = a2[i][j] = -4;
-			else if (abs(i-j) == 2)
-				a1[i][j] = a2[i][j] = 1;
+			e = &s->cache[i];
+			st->cached = 1;
+			break;
 		}
+		if (!e || s->cache[i].used < e->used)
+			e = &s->cache[i];
+	}
+	if (!st->cached)
+	{
+		t0 = wall_time();
+		server_evict(e);
+		if (system_create(&e->sys, (sys_id) sid, n, STORE_DEFAULT) != 0)
+			return ENOMEM;
+		e->sid = (sys_id) sid;
+		e->n = n;
+		st->setup = wall_time() - t0;
 	}
+	e->used = s->requests;
+
+	if (tol <= 0)
+		tol = MAX_ERROR;
+	else if (tol < FP_EPSILON * euclidean_norm(s->ctx, e->sys.b, n))
+		return EINVAL;
+	if (!(res = solve(s->ctx, method, &e->sys.op, e->sys.b, n, tol)))
+		return s->ctx->error;
+	memcpy(x, res, n * sizeof(fptype));
+	st->run = s->ctx->stats;
+	return 0;
 }
 
 
-void write_2d_matrix(char *filename, fptype **mat, int n)
+void PREC_NAME(set2_server_destroy)(server_t *s)
 {
-	int i, j;
-	FILE *outfile;
+	int i;
 
-#ifdef PRINT_TOFILE
-	outfile = fopen(filename, "w");
-	if (!outfile)
-	{
-		perror("fopen");
+	if (!s)
 		return;
-	}
-#else
-	outfile = stdout;
-#endif
+	for (i = 0; i < SERVER_CACHE; i++)
+		server_evict(&s->cache[i]);
+	PREC_NAME(set2_ctx_destroy)(s->ctx);
+	free(s);
+}
 
-	for (i = 0; i < n; i++)
-	{
-		for (j = 0; j < n; j++)
-			fprintf(outfile, "%8.4f  ", mat[i][j]);
-		fprintf(outfile, "\n");
-	}
 
-#ifdef PRINT_TOFILE
-	fclose(outfile);
-#endif
+static void server_evict(server_entry_t *e)
+{
+	if (e->sid)
+		system_destroy(&e->sys);
+	memset(e, 0, sizeof(server_entry_t));
 }
 
 
-void write_1d_matrix(char *filename, fptype *mat, int n)
+/*
+ * Times the product by A2 in storage, the kernel of both methods:
+ * warmup untimed runs are followed by reps timed ones.
+ */
+int PREC_NAME(set2_bench)(int n, set2_storage storage, int warmup, int reps,
+		bench_result_t *res)
 {
-	int i;
-	FILE *outfile;
+	int r, ret = EXIT_FAILURE;
+	system_t sys;
+	fptype *y;
+	double *t, t0, nnz = (n > 1) ? 5.0 * n - 6 : 1, elems = 0;
 
-#ifdef PRINT_TOFILE
-	outfile = fopen(filename, "w");
-	if (!outfile)
+	if (system_create(&sys, S2, n, storage) != 0)
+		return EXIT_FAILURE;
+	if (!(y = alloc_1d_matrix(n)))
+		goto out_sys;
+	if (!(t = (double *) malloc(reps * sizeof(double))))
 	{
-		perror("fopen");
-		return;
+		perror("malloc");
+		goto out_y;
 	}
-#else
-	outfile = stdout;
-#endif
 
-	for (i = 0; i < n; i++)
-		fprintf(outfile, "%8.4f\n", mat[i]);
+	for (r = -warmup; r < reps; r++)
+	{
+		t0 = wall_time();
+		sys.op.rows(&sys.op, y, sys.b, 0, n);
+		if (r >= 0)
+			t[r] = wall_time() - t0;
+	}
 
-#ifdef PRINT_TOFILE
-	fclose(outfile);
+	/* Elements of A read, in its storage; CSR adds the indices */
+	res->flops = 2 * nnz;
+	if (sys.op.dense)
+	{
+#ifdef OPTIMIZED
+		elems = nnz;
+#else
+		elems = (double) n * n;
+		res->flops = 2 * elems;
 #endif
+	}
+	else if (sys.op.dia)
+		elems = (double) sys.op.dia->ndiag * n;
+	else if (sys.op.csr)
+		elems = nnz + (nnz * sizeof(int32_t) + (n + 1.0) * sizeof(int64_t)) /
+				sizeof(fptype);
+	res->bytes = (elems + 2.0 * n) * sizeof(fptype);
+	bench_stats(res, t, reps);
+	ret = EXIT_SUCCESS;
+
+	free(t);
+out_y:
+	free(y);
+out_sys:
+	system_destroy(&sys);
+	return ret;
 }
 
 
-#ifdef PRINT_INPUT_MATRICES
-void print_input_matrices(void)
+/* Median and 95th percentile (nearest rank) of reps run times, sorted in place */
+static void bench_stats(bench_result_t *res, double *t, int reps)
 {
-	#ifndef PRINT_TOFILE
-	printf("\nWriting A1...\n");
-	#endif
-	snprintf(filename, BUFF_SIZE, "a1_%d.txt", n);
-	write_2d_matrix(filename, a1, n);
-	#ifndef PRINT_TOFILE
-	printf("\nWriting A2...\n");
-	#endif
-	snprintf(filename, BUFF_SIZE, "a2_%d.txt", n);
-	write_2d_matrix(filename, a2, n);
-	#ifndef PRINT_TOFILE
-	printf("\nWriting B1...\n");
-	#endif
-	snprintf(filename, BUFF_SIZE, "b1_%d.txt", n);
-	write_1d_matrix(filename, b1, n);
-	#ifndef PRINT_TOFILE
-	printf("\nWriting B2...\n");
-	#endif
-	snprintf(filename, BUFF_SIZE, "b2_%d.txt", n);
-	write_1d_matrix(filename, b2, n);
+	qsort(t, reps, sizeof(double), bench_cmp);
+	res->median = (reps % 2) ? t[reps/2] : (t[reps/2-1] + t[reps/2]) / 2;
+	res->p95 = t[(int) ceil(0.95 * reps) - 1];
 }
-#endif
 
 
-void solve_system(fptype **a, fptype *b, int n, sys_id sid)
+static int bench_cmp(const void *a, const void *b)
 {
-	int i;
-	fptype *x;
-#ifdef PRINT_RESULTS
-	char filename[BUFF_SIZE];
-#endif
-	printf("\n######################\n");
-	printf("# System: No.%1d       #\n", sid);
-	printf("######################\n");
-	for (i = 0; i < NUM_METHODS; i++)
-	{
-		printf("\n# Method: %s\n", method_names[i]);
-		if (!(x = (methods[i])(a, b, MAX_ERROR, n)))
-			continue;
-#ifdef PRINT_RESULTS
-	#ifndef PRINT_TOFILE
-		printf("\nWriting X%d...\n", sid);
-	#endif
-		snprintf(filename, BUFF_SIZE, "x%1d_%d_%2s.txt", sid, n, method_initials[i]);
-		write_1d_matrix(filename, x, n);
-#endif
-		free(x);
-	}
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
 }
 
 
-fptype *steepest_descent(fptype **A, fptype *b, fptype max_error, int n)
+static fptype *steepest_descent(ctx_t *ctx, operator_t *A, fptype *b, fptype max_error,
+		int n)
 {
-	int k, j_retval;
-	fptype *x, *r, *Ar, *Ax, *tmp, a;
+	int k;
+	fptype *x, *r, *Ar, *Ax, *tmp, a, rnorm;
+	arena_t *ws = &ctx->ws;
 
-	if (alloc_1d_matrices(n, 5, &x, &r, &Ar, &Ax, &tmp) != 0)
-		return NULL;
+	TRACE_SCOPE("steepest_descent");
 
-	if ((j_retval = setjmp(j_error_env)) != 0)
+	if (!(x = arena_alloc_1d(ws, n)) || !(r = arena_alloc_1d(ws, n)) ||
+			!(Ar = arena_alloc_1d(ws, n)) || !(Ax = arena_alloc_1d(ws, n)) ||
+			!(tmp = arena_alloc_1d(ws, n)))
 	{
-		fprintf(stderr, "Aborting Steepest Descent execution"
-				" (exit code: %d)...\n", j_retval);
-		free_1d_matrices(5, x, r, Ar, Ax, tmp);
+		set_error(ctx, ENOMEM, "workspace exhausted");
 		return NULL;
 	}
 
+	if (setjmp(ctx->env) != 0)
+		return NULL;
+
 	// Vector x^(0) is already the zero vector
 	memcpy(r, b, n*sizeof(fptype)); // r^(0) = b;
 	k = 0;
-	while (euclidean_norm(r, n) > max_error)
+	while ((rnorm = euclidean_norm(ctx, r, n)) > max_error && k < SD_MAX_ITER(n))
 	{
+		TRACE_SCOPE("sd_iteration");
+
 		k++;
 		// Ar = A * r^(k-1)
-		Ar = matrix_vector_multiplication(Ar, A, r, n);
+		Ar = matrix_vector_multiplication(ctx, Ar, A, r, n);
 		// a_k = (r^(k-1), r^(k-1)) / (Ar, r^(k-1))
-		a  = dot_product(r, r, n) / dot_product(Ar, r, n);
+		a  = dot_product(ctx, r, r, n) / dot_product(ctx, Ar, r, n);
 		// x^(k) = x^(k-1) + a_k * r^(k-1)
-		x  = add_vectors(x, x, scalar_vector_multiplication(tmp, a, r, n), n);
+		x  = add_vectors(ctx, x, x, scalar_vector_multiplication(ctx, tmp, a, r, n), n);
 		// Ax = A * x^(k)
-		Ax = matrix_vector_multiplication(Ax, A, x, n);
+		Ax = matrix_vector_multiplication(ctx, Ax, A, x, n);
 #ifndef OPTIMIZED
 		// r^(k) = b - Ax
-		r  = subtract_vectors(r, b, Ax, n);
+		r  = subtract_vectors(ctx, r, b, Ax, n);
 #else
 		// r^(k) = r^(k-1) - a_k * Ar
-		r  = subtract_vectors(r, r, scalar_vector_multiplication(Ar, a, Ar, n), n);
+		r  = subtract_vectors(ctx, r, r, scalar_vector_multiplication(ctx, Ar, a, Ar, n), n);
 #endif
 	}
 
-	printf("\nk = %d\n", k);
-
-	free_1d_matrices(4, r, Ar, Ax, tmp);
-
+	ctx->stats.iterations = k;
+	ctx->stats.residual = rnorm;
+	if (rnorm > max_error)
+	{
+		set_error(ctx, ETIMEDOUT, "steepest_descent: no convergence");
+		return NULL;
+	}
 	return x;
 }
 
 
-fptype *conjugate_gradients(fptype **A, fptype *b, fptype max_error, int n)
+static fptype *conjugate_gradients(ctx_t *ctx, operator_t *A, fptype *b,
+		fptype max_error, int n)
 {
-	int k, j_retval;
-	fptype *x, *r[3], *p, a_k, b_k, *Ap, *Ax, *tmp, *tmp_ptr;
+	int k;
+	fptype *x, *r[3], *p, a_k, b_k, *Ap, *Ax, *tmp, rnorm;
+#ifdef OPTIMIZED
+	fptype rr, rr_old;
+#else
+	fptype *tmp_ptr;
+#endif
+	arena_t *ws = &ctx->ws;
 
-	if (alloc_1d_matrices(n, 8, &x, r, r+1, r+2, &p, &Ap, &Ax, &tmp) != 0)
-		return NULL;
+	TRACE_SCOPE("conjugate_gradients");
 
-	if ((j_retval = setjmp(j_error_env)) != 0)
+	if (!(x = arena_alloc_1d(ws, n)) || !(r[0] = arena_alloc_1d(ws, n)) ||
+			!(r[1] = arena_alloc_1d(ws, n)) || !(r[2] = arena_alloc_1d(ws, n)) ||
+			!(p = arena_alloc_1d(ws, n)) || !(Ap = arena_alloc_1d(ws, n)) ||
+			!(Ax = arena_alloc_1d(ws, n)) || !(tmp = arena_alloc_1d(ws, n)))
 	{
-		fprintf(stderr, "Aborting Conjugate Gradient execution"
-				" (exit code: %d)...\n", j_retval);
-		free_1d_matrices(8, x, r[0], r[1], r[2], p, Ap, Ax, tmp);
+		set_error(ctx, ENOMEM, "workspace exhausted");
 		return NULL;
 	}
 
+	if (setjmp(ctx->env) != 0)
+		return NULL;
+
 	// Vector x^(0) is already the zero vector
 	memcpy(r[0], b, n*sizeof(fptype)); // r^(0) = b;
 	memcpy(p, r[0], n*sizeof(fptype)); // p^(0) = r^(0);
 	// Ap = A * p^(1)
-	Ap = matrix_vector_multiplication(Ap, A, p, n);
+	Ap = matrix_vector_multiplication(ctx, Ap, A, p, n);
 	// a_1 = (r^(0), r^(0)) / (Ap, p^(1))
-	a_k = dot_product(r[0], r[0], n) / dot_product(Ap, p, n);
+	a_k = dot_product(ctx, r[0], r[0], n) / dot_product(ctx, Ap, p, n);
 	// x^(1) = x^(0) + a_1 * p^(1)
-	x = add_vectors(x, x, scalar_vector_multiplication(tmp, a_k, p, n), n);
+	x = add_vectors(ctx, x, x, scalar_vector_multiplication(ctx, tmp, a_k, p, n), n);
 	// Ax = A * x^(1)
-	Ax = matrix_vector_multiplication(Ax, A, x, n);
+	Ax = matrix_vector_multiplication(ctx, Ax, A, x, n);
 	// r^(1) = b - Ax
-	r[1] = subtract_vectors(r[1], b, Ax, n);
+	r[1] = subtract_vectors(ctx, r[1], b, Ax, n);
 	k = 1;
-	while (euclidean_norm(r[1], n) > max_error && k < n)
+#ifdef OPTIMIZED
+	/*
+	 * Fused iterations: r^(k) is updated in place and its squared norm,
+	 * which the next b_k and a_k divide by, comes with it, so every
+	 * iteration sweeps the vectors twice (see cg_direction() and
+	 * cg_step()) and keeps no temporaries.
+	 */
+	rr = dot_product(ctx, r[1], r[1], n);
+	rr_old = dot_product(ctx, r[0], r[0], n);
+	while ((rnorm = FP_SQRT(rr)) > max_error && k < n)
+	{
+		TRACE_SCOPE("cg_iteration");
+
+		k++;
+		// b_k = (r^(k-1), r^(k-1)) / (r^(k-2), r^(k-2))
+		b_k = rr / rr_old;
+		// p^(k) = r^(k-1) + b_k * p^(k-1), Ap = A * p^(k)
+		// a_k = (r^(k-1), r^(k-1)) / (Ap, p^(k))
+		a_k = rr / cg_direction(ctx, A, p, Ap, r[1], b_k, n);
+		// x^(k) = x^(k-1) + a_k * p^(k), r^(k) = r^(k-1) - a_k * Ap
+		rr_old = rr;
+		rr = cg_step(ctx, x, r[1], p, Ap, a_k, n);
+	}
+#else
+	while ((rnorm = euclidean_norm(ctx, r[1], n)) > max_error && k < n)
 	{
+		TRACE_SCOPE("cg_iteration");
+
 		k++;
 		// b_k = (r^(k-1), r^(k-1)) / (r^(k-2), r^(k-2))
-		b_k = dot_product(r[1], r[1], n) / dot_product(r[0], r[0], n);
+		b_k = dot_product(ctx, r[1], r[1], n) / dot_product(ctx, r[0], r[0], n);
 		// p^(k) = r^(k-1) + b_k * p^(k-1)
-		p = add_vectors(p, r[1], scalar_vector_multiplication(tmp, b_k, p, n), n);
+		p = add_vectors(ctx, p, r[1], scalar_vector_multiplication(ctx, tmp, b_k, p, n), n);
 		// Ap = A * p^(k)
-		Ap = matrix_vector_multiplication(Ap, A, p, n);
+		Ap = matrix_vector_multiplication(ctx, Ap, A, p, n);
 		// a_k = (r^(k-1), r^(k-1)) / (Ap, p^(k))
-		a_k = dot_product(r[1], r[1], n) / dot_product(Ap, p, n);
+		a_k = dot_product(ctx, r[1], r[1], n) / dot_product(ctx, Ap, p, n);
 		// x^(k) = x^(k-1) + a_k * p^(k)
-		x = add_vectors(x, x, scalar_vector_multiplication(tmp, a_k, p, n), n);
+		x = add_vectors(ctx, x, x, scalar_vector_multiplication(ctx, tmp, a_k, p, n), n);
 		// Ax = A * x^(k)
-		Ax = matrix_vector_multiplication(Ax, A, x, n);
-#ifndef OPTIMIZED
+		Ax = matrix_vector_multiplication(ctx, Ax, A, x, n);
 		// r^(k) = b - Ax
-		r[2] = subtract_vectors(r[2], b, Ax, n);
-#else
-		// r^(k) = r^(k-1) - a_k * Ap
-		r[2] = subtract_vectors(r[2], r[1], scalar_vector_multiplication(Ap, a_k, Ap, n), n);
-#endif
+		r[2] = subtract_vectors(ctx, r[2], b, Ax, n);
 		// Shift left r[i] in a round-robin manner
 		tmp_ptr = r[0];
 		r[0] = r[1];
 		r[1] = r[2];
 		r[2] = tmp_ptr;
 	}
+#endif
+
+	ctx->stats.iterations = k;
+	ctx->stats.residual = rnorm;
+	return x;
+}
 
-	printf("\nk = %d\n", k);
 
-	free_1d_matrices(7, r[0], r[1], r[2], p, Ap, Ax, tmp);
+#ifdef OPTIMIZED
+/*
+ * First sweep of a fused CG iteration: p = r + b_k * p, Ap = A * p, and
+ * returns (Ap, p). A * p runs in blocks of DIRECTION_BLOCK rows, each
+ * preceded by the update of the part of p it reads (up to A->reach
+ * columns past it), so that p is still in cache when the product and
+ * (Ap, p) read it. Every sum is taken in the order of the unfused
+ * kernels, so the iterates do not change as long as neither is contracted
+ * into fused multiply-adds (the Makefile builds with -ffp-contract=off).
+ */
+static fptype cg_direction(ctx_t *ctx, operator_t *A, fptype *p, fptype *Ap,
+		fptype *r, fptype b_k, int n)
+{
+	int i, lo, hi, end, ready = 0;
+	fptype pAp = 0.0;
 
-	return x;
+	if (!A || !p || !Ap || !r)
+	{
+		set_error(ctx, 7, "cg_direction: argument is NULL");
+		longjmp(ctx->env, 7);
+		// This LOC should never be reached!
+		return -1;
+	}
+
+	for (lo = 0; lo < n; lo = hi)
+	{
+		hi = (n - lo > DIRECTION_BLOCK) ? lo + DIRECTION_BLOCK : n;
+		end = (A->reach < n - hi) ? hi + A->reach : n;
+		update_direction(p, r, b_k, ready, end);
+		ready = end;
+		A->rows(A, Ap, p, lo, hi);
+		for (i = lo; i < hi; i++)
+			pAp += Ap[i] * p[i];
+	}
+	return pAp;
+}
+
+
+/* p = r + b_k * p over elements lo..hi-1 */
+static void update_direction(fptype *p, fptype *r, fptype b_k, int lo, int hi)
+{
+	int i = lo;
+	fpvec pv, rv;
+
+	for (; i + VEC_LANES <= hi; i += VEC_LANES)
+	{
+		memcpy(&pv, p + i, sizeof(fpvec));
+		memcpy(&rv, r + i, sizeof(fpvec));
+		pv = rv + pv * b_k;
+		memcpy(p + i, &pv, sizeof(fpvec));
+	}
+	for (; i < hi; i++)
+		p[i] = r[i] + p[i] * b_k;
+}
+
+
+/*
+ * Second sweep of a fused CG iteration: x = x + a_k * p, r = r - a_k * Ap,
+ * and returns (r, r).
+ */
+static fptype cg_step(ctx_t *ctx, fptype *x, fptype *r, fptype *p, fptype *Ap,
+		fptype a_k, int n)
+{
+	int i;
+	fptype rr = 0.0;
+
+	if (!x || !r || !p || !Ap)
+	{
+		set_error(ctx, 8, "cg_step: argument is NULL");
+		longjmp(ctx->env, 8);
+		// This LOC should never be reached!
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		x[i] += p[i] * a_k;
+		r[i] -= Ap[i] * a_k;
+		rr += r[i] * r[i];
+	}
+	return rr;
 }
+#endif
 
 
-fptype euclidean_norm(fptype *v, int n)
+static fptype euclidean_norm(ctx_t *ctx, fptype *v, int n)
 {
 	int i;
 	fptype sum = 0.0;
 
 	if (!v)
 	{
-		fprintf(stderr, "euclidean_norm: argument is NULL!\n");
-		longjmp(j_error_env, 1);
+		set_error(ctx, 1, "euclidean_norm: argument is NULL");
+		longjmp(ctx->env, 1);
 		// This LOC should never be reached!
 		return -1;
 	}
 
 	for (i = 0; i < n; i++)
 		sum += v[i] * v[i];
-#ifdef FPTYPE_DOUBLE
-	return sqrt(sum);
-#else
-	return sqrtf(sum);
-#endif
+	return FP_SQRT(sum);
 }
 
 
-fptype dot_product(fptype *v1, fptype *v2, int n)
+static fptype dot_product(ctx_t *ctx, fptype *v1, fptype *v2, int n)
 {
 	int i;
 	fptype prod = 0.0;
 
 	if (!v1 || !v2)
 	{
-		fprintf(stderr, "dot_product: argument is NULL!\n");
-		longjmp(j_error_env, 2);
+		set_error(ctx, 2, "dot_product: argument is NULL");
+		longjmp(ctx->env, 2);
 		// This LOC should never be reached!
 		return -1;
 	}
@@ -524,42 +2126,31 @@ fptype dot_product(fptype *v1, fptype *v2, int n)
 }
 
 
-fptype *matrix_vector_multiplication(fptype *res, fptype **mat, fptype *v, int n)
+static fptype *matrix_vector_multiplication(ctx_t *ctx, fptype *res, operator_t *mat,
+		fptype *v, int n)
 {
-	int i, j, lb, ub;
-
 	if (!res || !mat || !v)
 	{
-		fprintf(stderr, "matrix_vector_multiplication: argument is NULL!\n");
-		longjmp(j_error_env, 3);
+		set_error(ctx, 3, "matrix_vector_multiplication: argument is NULL");
+		longjmp(ctx->env, 3);
 		// This LOC should never be reached!
 		return NULL;
 	}
 
-	for (i = 0; i < n; i++)
-	{
-#ifdef OPTIMIZED
-		lb = (i >= 2)   ? i-2 : 0;
-		ub = (i <= n-3) ? i+2 : n-1;
-#else
-		lb = 0;
-		ub = n-1;
-#endif
-		for (j = lb, res[i] = 0.0; j <= ub; j++)
-			res[i] += mat[i][j] * v[j];
-	}
+	mat->rows(mat, res, v, 0, n);
 	return res;
 }
 
 
-fptype *scalar_vector_multiplication(fptype *res, fptype s, fptype *v, int n)
+static fptype *scalar_vector_multiplication(ctx_t *ctx, fptype *res, fptype s,
+		fptype *v, int n)
 {
 	int i;
 
 	if (!res || !v)
 	{
-		fprintf(stderr, "scalar_vector_multiplication: argument is NULL!\n");
-		longjmp(j_error_env, 4);
+		set_error(ctx, 4, "scalar_vector_multiplication: argument is NULL");
+		longjmp(ctx->env, 4);
 		// This LOC should never be reached!
 		return NULL;
 	}
@@ -571,14 +2162,14 @@ fptype *scalar_vector_multiplication(fptype *res, fptype s, fptype *v, int n)
 }
 
 
-fptype *add_vectors(fptype *res, fptype *v1, fptype *v2, int n)
+static fptype *add_vectors(ctx_t *ctx, fptype *res, fptype *v1, fptype *v2, int n)
 {
 	int i;
 
 	if (!res || !v1 || !v2)
 	{
-		fprintf(stderr, "add_vectors: argument is NULL!\n");
-		longjmp(j_error_env, 5);
+		set_error(ctx, 5, "add_vectors: argument is NULL");
+		longjmp(ctx->env, 5);
 		// This LOC should never be reached!
 		return NULL;
 	}
@@ -590,14 +2181,15 @@ fptype *add_vectors(fptype *res, fptype *v1, fptype *v2, int n)
 }
 
 
-fptype *subtract_vectors(fptype *res, fptype *v1, fptype *v2, int n)
+static fptype *subtract_vectors(ctx_t *ctx, fptype *res, fptype *v1, fptype *v2,
+		int n)
 {
 	int i;
 
 	if (!res || !v1 || !v2)
 	{
-		fprintf(stderr, "subtract_vectors: argument is NULL!\n");
-		longjmp(j_error_env, 6);
+		set_error(ctx, 6, "subtract_vectors: argument is NULL");
+		longjmp(ctx->env, 6);
 		// This LOC should never be reached!
 		return NULL;
 	}
@@ -609,47 +2201,47 @@ fptype *subtract_vectors(fptype *res, fptype *v1, fptype *v2, int n)
 }
 
 
-void free_1d_matrices(int num_args, ...)
+static double wall_time(void)
 {
-	va_list args;
-	fptype *ptr;
-	int i;
+	struct timespec ts;
 
-	va_start(args, num_args);
-	for (i = 0; i < num_args; i++)
-	{
-		ptr = va_arg(args, fptype *);
-		free(ptr);
-	}
-	va_end(args);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* CPU time of the calling thread */
+static double thread_cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 
-void free_2d_matrices(int n, int num_args, ...)
+static void free_1d_matrices(int num_args, ...)
 {
 	va_list args;
-	fptype **ptr;
+	fptype *ptr;
 	int i;
 
 	va_start(args, num_args);
 	for (i = 0; i < num_args; i++)
 	{
-		ptr = va_arg(args, fptype **);
-		free_2d_matrix(ptr, n);
+		ptr = va_arg(args, fptype *);
+		free(ptr);
 	}
 	va_end(args);
 }
 
 
-void free_2d_matrix(fptype **mat, int n)
+static void free_2d_matrix(fptype **mat, int n)
 {
-	int i;
-
 	if (!mat)
 		return;
 
-	for (i = 0; i < n; i++)
-		free(mat[i]);
+	free(mat[0]);
 	free(mat);
 }
 
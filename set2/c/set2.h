@@ -0,0 +1,116 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+#ifndef SET2_H
+#define SET2_H
+
+#include "binfmt.h"
+#include "csr.h"
+
+typedef enum {PREC_FLOAT, PREC_DOUBLE, PREC_LDOUBLE} precision;
+
+/*
+ * Storage of the coefficient matrix (-S). STORE_DEFAULT is the stencil in
+ * the OPTIMIZED build, dense in the other, and CSR for a matrix read with
+ * -i, which can be stored in CSR or DIA only.
+ */
+typedef enum {STORE_DEFAULT, STORE_DENSE, STORE_STENCIL, STORE_DIA, STORE_CSR,
+		NUM_STORAGES} set2_storage;
+
+/* Run-time options of set2_run() */
+typedef struct {
+	output_fmt    out;      /* Format of the solutions written */
+	const char   *input;    /* Sparse matrix file solved instead of A1, A2, or NULL */
+	int           threads;  /* Threads parsing a .mtx input */
+	int           jobs;     /* Workers of set2_run_jobs() */
+	set2_storage  storage;  /* Of A */
+} set2_opts_t;
+
+/* Iterative methods, in the order set2_run() applies them */
+typedef enum {SET2_SD, SET2_CG} set2_method;
+
+/* Outcome of the last solve of a context */
+typedef struct {
+	int     iterations;
+	double  residual;       /* ||r|| the last iteration stopped on */
+	double  seconds;
+} set2_stats_t;
+
+/* Run time of a product by A2 over the timed runs, and the work of one run */
+typedef struct {
+	double  median;         /* Seconds */
+	double  p95;
+	double  flops;
+	double  bytes;          /* Every operand read or written once */
+} bench_result_t;
+
+/* Outcome of a set2_server_solve() request */
+typedef struct {
+	int           cached;   /* The system was reused */
+	double        setup;    /* Seconds generating the system, 0 if cached */
+	set2_stats_t  run;      /* Of the solve */
+} server_stats_t;
+
+/*
+ * set2.c is compiled once per precision; each instance exports its entry
+ * points and a library API with a suffix naming its fptype. n is ignored
+ * when a matrix is read from opts->input; set2_run_jobs() runs every
+ * (system, method, n) combination concurrently instead.
+ *
+ * A solver context owns the workspace, the error state and the stats of
+ * its solves, and the library keeps no other state, so threads can solve
+ * concurrently as long as each uses its own context. set2_solve_dense()
+ * takes the row pointers of an n x n matrix (the OPTIMIZED build reads
+ * its pentadiagonal band only) and set2_solve_csr() a matrix of csr.h;
+ * both return EXIT_SUCCESS with x filled in, or EXIT_FAILURE with the
+ * reason in set2_ctx_error(). A set2_server is the state of daemon mode
+ * (-d): a context together with the systems it solved last.
+ * set2_bench() times the product by A2 of order n in a given storage.
+ */
+#define SET2_DECLARE(T, S)                                                      \
+	typedef struct set2_ctx##S set2_ctx##S;                                 \
+	typedef struct set2_server##S set2_server##S;                           \
+	int                  set2_run##S(int n, set2_opts_t *opts);              \
+	int                  set2_run_jobs##S(const int *sizes, int count,       \
+	                             set2_opts_t *opts);                         \
+	set2_ctx##S         *set2_ctx_create##S(void);                           \
+	void                 set2_ctx_destroy##S(set2_ctx##S *ctx);              \
+	int                  set2_solve_dense##S(set2_ctx##S *ctx,               \
+	                             set2_method method, T **a, T *b, int n,      \
+	                             T tol, T *x);                               \
+	int                  set2_solve_csr##S(set2_ctx##S *ctx,                 \
+	                             set2_method method, csr_matrix##S *a, T *b,  \
+	                             T tol, T *x);                               \
+	const set2_stats_t  *set2_ctx_stats##S(set2_ctx##S *ctx);                \
+	const char          *set2_ctx_error##S(set2_ctx##S *ctx);                \
+	set2_server##S      *set2_server_create##S(void);                        \
+	int                  set2_server_solve##S(set2_server##S *s, int sys,    \
+	                             int n, set2_method method, T tol, T *x,     \
+	                             server_stats_t *st);                        \
+	void                 set2_server_destroy##S(set2_server##S *s);        \
+	int                  set2_bench##S(int n, set2_storage storage,          \
+	                             int warmup, int reps, bench_result_t *res);
+
+SET2_DECLARE(float, _f)
+SET2_DECLARE(double, _d)
+SET2_DECLARE(long double, _ld)
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |               Copyright (C) 2020 George Z. Zachos                     |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "set2.h"
+#include "daemon.h"
+
+/* Daemon mode (-d): the state of every precision, created on first use */
+typedef struct {
+	set2_server_f   *f;
+	set2_server_d   *d;
+	set2_server_ld  *ld;
+	void            *x;
+	size_t           x_size;
+} daemon_state_t;
+
+/* Function Prototypes */
+static void  serve_request(const daemon_req_t *req, daemon_resp_t *resp,
+		const void **x, void *arg);
+
+
+int main(int argc, char **argv)
+{
+	int n, opt, i, *sizes, usage = 0;
+	precision prec = PREC_DOUBLE;
+	set2_opts_t opts = {OUT_TEXT, NULL, 0, 0, STORE_DEFAULT};
+	const char *socket_path = NULL;
+	daemon_state_t state;
+
+	while ((opt = getopt(argc, argv, "d:f:i:j:p:S:t:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				socket_path = optarg;
+				break;
+			case 'f':
+				if (!strcmp(optarg, "text"))
+					opts.out = OUT_TEXT;
+				else if (!strcmp(optarg, "binary"))
+					opts.out = OUT_BINARY;
+				else
+				{
+					fprintf(stderr, "Unknown output format: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'i':
+				opts.input = optarg;
+				break;
+			case 'j':
+				if ((opts.jobs = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of workers should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'p':
+				if (!strcmp(optarg, "float"))
+					prec = PREC_FLOAT;
+				else if (!strcmp(optarg, "double"))
+					prec = PREC_DOUBLE;
+				else if (!strcmp(optarg, "ldouble"))
+					prec = PREC_LDOUBLE;
+				else
+				{
+					fprintf(stderr, "Unknown precision: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 'S':
+				if (!strcmp(optarg, "dense"))
+					opts.storage = STORE_DENSE;
+				else if (!strcmp(optarg, "stencil"))
+					opts.storage = STORE_STENCIL;
+				else if (!strcmp(optarg, "dia"))
+					opts.storage = STORE_DIA;
+				else if (!strcmp(optarg, "csr"))
+					opts.storage = STORE_CSR;
+				else
+				{
+					fprintf(stderr, "Unknown storage: %s\n", optarg);
+					return EXIT_SUCCESS;
+				}
+				break;
+			case 't':
+				if ((opts.threads = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Number of threads should be positive!\n");
+					return EXIT_SUCCESS;
+				}
+				break;
+			default:
+				usage = 1;
+		}
+	}
+
+	if (usage || ((opts.input || socket_path) ? argc != optind :
+			(opts.jobs ? argc == optind : argc - optind != 1)))
+	{
+		fprintf(stderr, "Usage: %s [-f text|binary] [-p float|double|ldouble] "
+				"[-S dense|stencil|dia|csr] N\t(N > 0)\n"
+				"       %s [-f text|binary] [-p float|double|ldouble] "
+				"[-S dense|stencil|dia|csr] -j WORKERS N...\t"
+				"(all systems, methods and sizes at once)\n"
+				"       %s [-f text|binary] [-p float|double|ldouble] [-S dia|csr] "
+				"[-t threads] -i FILE\t(sparse SPD matrix, .mtx or binary CSR)\n"
+				"       %s -d SOCKET|-\t(serve solve requests, see daemon.h)\n",
+				argv[0], argv[0], argv[0], argv[0]);
+		return EXIT_SUCCESS;
+	}
+	if (opts.jobs && (opts.input || socket_path))
+	{
+		fprintf(stderr, "Concurrent jobs (-j) take neither -d nor -i!\n");
+		return EXIT_SUCCESS;
+	}
+
+	if (opts.input && (opts.storage == STORE_DENSE || opts.storage == STORE_STENCIL))
+	{
+		fprintf(stderr, "A matrix read with -i is stored in CSR or DIA only!\n");
+		return EXIT_SUCCESS;
+	}
+
+	if (socket_path)
+	{
+		if (opts.input)
+		{
+			fprintf(stderr, "Daemon mode (-d) takes no -i; "
+					"method and precision come with every request!\n");
+			return EXIT_SUCCESS;
+		}
+		memset(&state, 0, sizeof(state));
+		opt = daemon_serve(socket_path, serve_request, &state);
+		set2_server_destroy_f(state.f);
+		set2_server_destroy_d(state.d);
+		set2_server_destroy_ld(state.ld);
+		free(state.x);
+		return opt;
+	}
+
+	if (opts.jobs)
+	{
+		if (!(sizes = (int *) malloc((argc - optind) * sizeof(int))))
+		{
+			perror("malloc");
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < argc - optind; i++)
+		{
+			if ((sizes[i] = atoi(argv[optind+i])) <= 0)
+			{
+				fprintf(stderr, "Matrix size (N) should be positive!\n");
+				free(sizes);
+				return EXIT_SUCCESS;
+			}
+		}
+		switch (prec)
+		{
+			case PREC_FLOAT:
+				opt = set2_run_jobs_f(sizes, argc - optind, &opts);
+				break;
+			case PREC_LDOUBLE:
+				opt = set2_run_jobs_ld(sizes, argc - optind, &opts);
+				break;
+			default:
+				opt = set2_run_jobs_d(sizes, argc - optind, &opts);
+		}
+		free(sizes);
+		return opt;
+	}
+
+	if (opts.input)
+	{
+		n = 0;
+		if (opts.threads == 0)
+			opts.threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		printf("A = %s\n", opts.input);
+	}
+	else if ((n = atoi(argv[optind])) <= 0)
+	{
+		fprintf(stderr, "Matrix size (N) should be positive!\n");
+		return EXIT_SUCCESS;
+	}
+	else
+		printf("N = %d\n", n);
+
+	switch (prec)
+	{
+		case PREC_FLOAT:
+			return set2_run_f(n, &opts);
+		case PREC_LDOUBLE:
+			return set2_run_ld(n, &opts);
+		default:
+			return set2_run_d(n, &opts);
+	}
+}
+
+
+/*
+ * Solves req with the state of its precision, which is created by the
+ * first request in that precision; see daemon.h.
+ */
+static void serve_request(const daemon_req_t *req, daemon_resp_t *resp,
+		const void **x, void *arg)
+{
+	daemon_state_t *st = (daemon_state_t *) arg;
+	server_stats_t stats;
+	size_t elem_size, size;
+	void *p;
+
+	switch (req->precision)
+	{
+		case PREC_FLOAT:
+			elem_size = sizeof(float);
+			break;
+		case PREC_DOUBLE:
+			elem_size = sizeof(double);
+			break;
+		case PREC_LDOUBLE:
+			elem_size = sizeof(long double);
+			break;
+		default:
+			resp->status = EINVAL;
+			return;
+	}
+	if (req->n == 0 || req->n > INT32_MAX)
+	{
+		resp->status = EINVAL;
+		return;
+	}
+	if ((size = req->n * elem_size) > st->x_size)
+	{
+		if (!(p = realloc(st->x, size)))
+		{
+			resp->status = ENOMEM;
+			return;
+		}
+		st->x = p;
+		st->x_size = size;
+	}
+
+	switch (req->precision)
+	{
+		case PREC_FLOAT:
+			if (!st->f && !(st->f = set2_server_create_f()))
+				resp->status = ENOMEM;
+			else
+				resp->status = set2_server_solve_f(st->f, req->system, req->n,
+						(set2_method) req->method, (float) req->tol,
+						(float *) st->x, &stats);
+			break;
+		case PREC_LDOUBLE:
+			if (!st->ld && !(st->ld = set2_server_create_ld()))
+				resp->status = ENOMEM;
+			else
+				resp->status = set2_server_solve_ld(st->ld, req->system, req->n,
+						(set2_method) req->method, (long double) req->tol,
+						(long double *) st->x, &stats);
+			break;
+		default:
+			if (!st->d && !(st->d = set2_server_create_d()))
+				resp->status = ENOMEM;
+			else
+				resp->status = set2_server_solve_d(st->d, req->system, req->n,
+						(set2_method) req->method, req->tol,
+						(double *) st->x, &stats);
+	}
+	if (resp->status != 0)
+		return;
+
+	resp->n = req->n;
+	resp->elem_size = (uint32_t) elem_size;
+	resp->iterations = stats.run.iterations;
+	resp->cached = (uint32_t) stats.cached;
+	resp->setup = stats.setup;
+	resp->solve = stats.run.seconds;
+	resp->residual = stats.run.residual;
+	*x = st->x;
+}